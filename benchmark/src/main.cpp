@@ -4,6 +4,8 @@
 
 #include <antity/core/archetype.hpp>
 #include <entt/entt.hpp>
+#include <random>
+#include <sstream>
 
 enum ECS : uint8_t { _entt, _ant };
 
@@ -32,6 +34,29 @@ struct acceleration {
     float y;
 };
 
+// same layout, stored field by field
+struct soa_position {
+    float x;
+    float y;
+};
+
+struct soa_speed {
+    float x;
+    float y;
+};
+
+template <>
+struct ant::soa_layout<soa_position> {
+    static constexpr auto fields
+        = std::make_tuple(&soa_position::x, &soa_position::y);
+};
+
+template <>
+struct ant::soa_layout<soa_speed> {
+    static constexpr auto fields
+        = std::make_tuple(&soa_speed::x, &soa_speed::y);
+};
+
 template <ECS ecs>
 class reg {};
 
@@ -65,6 +90,9 @@ class reg<_ant> {
    public:
     using type = typename ant::registry;
     using entity_type = ant::registry::entity_type;
+
+    reg(ant::storage_config config = {}) : entityManager(config) {}
+
     entity_type create() { return entityManager.create(); };
 
     template <typename C, typename... Args>
@@ -167,8 +195,8 @@ void SystemBench(size_t count) {
 }
 
 template <size_t comp_count>
-void antt_for_each_bench(size_t count) {
-    auto registry = reg<ECS::_ant>();
+void antt_for_each_bench(size_t count, ant::storage_config config = {}) {
+    auto registry = reg<ECS::_ant>(config);
     for (size_t i = 0; i < count; i++) {
         auto entity_t = registry.create();
         if constexpr (comp_count >= 1) {
@@ -182,9 +210,11 @@ void antt_for_each_bench(size_t count) {
                                                  acceleration{.5f, .8f});
         }
     }
+    const char *storage
+        = config.policy == ant::storage_policy::chunked ? " chunked" : "";
     ankerl::nanobench::Bench().run(
         std::to_string(count) + " ant | entities with " + std::to_string(comp_count)
-            + " ant::for_each ",
+            + " ant::for_each" + storage,
         [&] {
             if constexpr (comp_count == 1) {
                 registry.for_each(
@@ -208,6 +238,192 @@ void antt_for_each_bench(size_t count) {
         });
 }
 
+template <ECS ecs>
+void MigrationBench(size_t count) {
+    ankerl::nanobench::Bench().run(
+        std::to_string(count) + " entities migrating twice " + to_string<ecs>(),
+        [&] {
+            auto registry = reg<ecs>();
+            std::vector<typename reg<ecs>::entity_type> entities;
+            for (size_t i = 0; i < count; i++) {
+                entities.push_back(registry.create());
+                registry.template add_component<position>(entities.back(),
+                                                          position{.5f, .8f});
+            }
+            for (auto entity : entities) {
+                registry.template add_component<speed>(entity,
+                                                       speed{.5f, .8f});
+            }
+            for (auto entity : entities) {
+                registry.template add_component<acceleration>(
+                    entity, acceleration{.5f, .8f});
+            }
+        });
+}
+
+void MigrationBenchmark(const std::vector<size_t> &v) {
+    for (auto i : v) {
+        MigrationBench<_entt>(i);
+        MigrationBench<_ant>(i);
+    }
+}
+
+void BatchCreateBenchmark(const std::vector<size_t> &v) {
+    for (auto count : v) {
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | create<position, speed>", [&] {
+                ant::registry registry;
+                for (size_t i = 0; i < count; i++) {
+                    registry.create<position, speed>(0, position{.5f, .8f},
+                                                     speed{.5f, .8f});
+                }
+            });
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | create_n<position, speed>", [&] {
+                ant::registry registry;
+                registry.create_n<position, speed>(
+                    count, 0, position{.5f, .8f}, speed{.5f, .8f});
+            });
+    }
+}
+
+void ParallelForEachBenchmark(const std::vector<size_t> &v) {
+    for (auto count : v) {
+        ant::registry registry({ant::storage_policy::chunked});
+        registry.create_n<position, speed>(count, ant::_null_chunk,
+                                           position{.5f, .8f}, speed{.5f, .8f});
+        auto update = [](ant::entity_t e, position &pos, speed &s) {
+            pos.x += s.x;
+            pos.y += s.y;
+        };
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | for_each<position, speed>",
+            [&] { registry.for_each(update); });
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | par_for_each<position, speed>",
+            [&] { registry.par_for_each(update); });
+    }
+}
+
+void SoaBenchmark(const std::vector<size_t> &v) {
+    constexpr float dt = 0.016f;
+    for (auto count : v) {
+        ant::registry registry({ant::storage_policy::chunked});
+        registry.create_n<position, speed>(count, ant::_null_chunk,
+                                           position{.5f, .8f}, speed{.5f, .8f});
+        registry.create_n<soa_position, soa_speed>(
+            count, ant::_null_chunk, soa_position{.5f, .8f},
+            soa_speed{.5f, .8f});
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | for_each_span gravity aos", [&] {
+                registry.for_each_span([](std::span<const ant::entity_t>,
+                                          std::span<position> p,
+                                          std::span<speed> s) {
+                    position *__restrict pos = ant::aligned_data(p);
+                    speed *__restrict spd = ant::aligned_data(s);
+                    for (size_t i = 0; i < p.size(); i++) {
+                        spd[i].y -= 9.81f * dt;
+                        pos[i].y += spd[i].y * dt;
+                    }
+                });
+            });
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | for_each_span gravity soa", [&] {
+                registry.for_each_span([](std::span<const ant::entity_t>,
+                                          ant::soa_span<soa_position> p,
+                                          ant::soa_span<soa_speed> s) {
+                    float *__restrict y
+                        = ant::aligned_data(p.get<&soa_position::y>());
+                    float *__restrict sy
+                        = ant::aligned_data(s.get<&soa_speed::y>());
+                    for (size_t i = 0; i < p.size(); i++) {
+                        sy[i] -= 9.81f * dt;
+                        y[i] += sy[i] * dt;
+                    }
+                });
+            });
+    }
+}
+
+void CommandBufferBenchmark(const std::vector<size_t> &v) {
+    for (auto count : v) {
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | add<speed, acceleration>", [&] {
+                ant::registry registry;
+                auto entities = registry.create_n<position>(
+                    count, ant::_null_chunk, position{.5f, .8f});
+                for (auto entity : entities) {
+                    registry.add<speed>(entity, speed{.5f, .8f});
+                    registry.add<acceleration>(entity, acceleration{.5f, .8f});
+                }
+            });
+        ankerl::nanobench::Bench().run(
+            std::to_string(count)
+                + " ant | command_buffer add<speed, acceleration>",
+            [&] {
+                ant::registry registry;
+                auto entities = registry.create_n<position>(
+                    count, ant::_null_chunk, position{.5f, .8f});
+                ant::command_buffer buffer;
+                for (auto entity : entities) {
+                    buffer.add<speed>(entity, speed{.5f, .8f});
+                    buffer.add<acceleration>(entity, acceleration{.5f, .8f});
+                }
+                registry.apply(buffer);
+            });
+    }
+}
+
+void RandomAccessBenchmark(const std::vector<size_t> &v) {
+    for (auto count : v) {
+        ant::registry registry;
+        std::vector<ant::entity_t> entities;
+        for (size_t i = 0; i < count; i++) {
+            // spread over three archetypes
+            entities.push_back(registry.create());
+            registry.add<position>(entities.back(), position{.5f, .8f});
+            if (i % 3 >= 1) {
+                registry.add<speed>(entities.back(), speed{.5f, .8f});
+            }
+            if (i % 3 >= 2) {
+                registry.add<acceleration>(entities.back(),
+                                           acceleration{.5f, .8f});
+            }
+        }
+        std::shuffle(entities.begin(), entities.end(), std::mt19937{42});
+        ankerl::nanobench::Bench().run(
+            std::to_string(count)
+                + " ant | random get_entity_components<position>",
+            [&] {
+                for (auto entity : entities) {
+                    auto [pos] = registry.get_entity_components<position>(entity);
+                    pos.x += .1f;
+                }
+            });
+    }
+}
+
+void SnapshotBenchmark(const std::vector<size_t> &v) {
+    for (auto count : v) {
+        ant::registry registry;
+        registry.create_n<position, speed>(count, 0, position{.5f, .8f},
+                                           speed{.5f, .8f});
+        std::stringstream stream;
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | snapshot<position, speed>", [&] {
+                stream.str({});
+                registry.snapshot(stream);
+            });
+        ant::registry restored;
+        restored.save<position, speed>();
+        ankerl::nanobench::Bench().run(
+            std::to_string(count) + " ant | restore<position, speed>", [&] {
+                stream.seekg(0);
+                restored.restore(stream);
+            });
+    }
+}
+
 void EmptyEntitiesBenchmmark(const std::vector<size_t> &v) {
     for (auto i : v) {
         EmptyEntitiesBench<_entt>(i);
@@ -235,16 +451,19 @@ void CompBenchmark(const std::vector<size_t> &v) {
         SystemBench<_entt, 1>(i);
         //SystemBench<_ant, 1>(i);
         antt_for_each_bench<1>(i);
+        antt_for_each_bench<1>(i, {ant::storage_policy::chunked});
     }
     for (auto i : v) {
         SystemBench<_entt, 2>(i);
         //SystemBench<_ant, 2>(i);
         antt_for_each_bench<2>(i);
+        antt_for_each_bench<2>(i, {ant::storage_policy::chunked});
     }
     for (auto i : v) {
         SystemBench<_entt, 3>(i);
         //SystemBench<_ant, 3>(i);
         antt_for_each_bench<3>(i);
+        antt_for_each_bench<3>(i, {ant::storage_policy::chunked});
     }
 }
 
@@ -262,4 +481,11 @@ int main() {
     UtilityBenchmark();
 
     CompBenchmark(v);
+    MigrationBenchmark(v);
+    BatchCreateBenchmark(v);
+    ParallelForEachBenchmark(v);
+    SoaBenchmark(v);
+    CommandBufferBenchmark(v);
+    RandomAccessBenchmark(v);
+    SnapshotBenchmark(v);
 }
@@ -1,9 +1,15 @@
 #pragma once
 
+#include "core/command_buffer.hpp"
 #include "core/component.hpp"
 #include "core/identifier.hpp"
+#include "core/observer.hpp"
+#include "core/query.hpp"
 #include "core/registry.hpp"
 #include "core/registry_debugger.hpp"
+#include "core/scheduler.hpp"
+#include "core/soa.hpp"
+#include "core/sparse_set.hpp"
 #include "core/view.hpp"
 #include "utility/hasher.hpp"
 #include "utility/unique_id_dispenser.hpp"
@@ -1,18 +1,72 @@
 #pragma once
 #include <antity/core/identifier.hpp>
+#include <antity/core/soa.hpp>
+#include <antity/core/sparse_set.hpp>
 #include <antity/utility/function_traits.hpp>
 #include <antity/utility/hasher.hpp>
+#include <algorithm>
 #include <cstddef>
 #include <functional>
+#include <limits>
+#include <memory_resource>
+#include <stdexcept>
+#include <vector>
 
 namespace ant {
     struct archetype;
 
     typedef std::byte* ComponentData;
 
+    /**
+     * @brief how the columns of an archetype are laid out in memory
+     *        contiguous : one growing allocation per component
+     *        chunked : list of fixed size blocks, growing only appends a
+     *                  block so live components are never relocated
+     */
+    enum class storage_policy : uint8_t { contiguous, chunked };
+
+    inline constexpr size_t _default_block_size = 16 * 1024;
+
+    /**
+     * @brief in a contiguous archetype every row lives in block 0
+     */
+    inline constexpr size_t _contiguous_block_shift
+        = std::numeric_limits<size_t>::digits - 1;
+
+    /**
+     * @brief column_index entry of the components an archetype doesn't have
+     */
+    inline constexpr uint16_t _no_column = std::numeric_limits<uint16_t>::max();
+
+    /**
+     * @brief archetypes whose highest component id is below get a dense
+     *        column_index, the others search their sorted component ids
+     */
+    inline constexpr component_id_t _dense_column_limit = 256;
+
+    struct storage_config {
+        storage_policy policy = storage_policy::contiguous;
+        // bytes of a block, shared between all the columns of an archetype
+        size_t block_size = _default_block_size;
+        // backs the column blocks and the column and entity arrays of the
+        // archetypes, their lookup tables and bookkeeping use the default
+        // allocator. has to outlive the registry
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+    };
+
     struct byte_array {
-        std::byte* componentData;
+        std::vector<std::byte*> blocks;
+        // bytes allocated per block
         size_t size;
+        // false when blocks point into memory the archetype doesn't own,
+        // e.g a mapped snapshot, which is copied before growing and never
+        // deallocated
+        bool owned = true;
+        // epoch each block was last handed out for writing, blocks past the
+        // end weren't since the column was created
+        std::vector<uint64_t> written;
+        // epoch a component was last added to a row of each block
+        std::vector<uint64_t> added;
     };
 
     struct archetype_key {
@@ -33,7 +87,7 @@ namespace ant {
 
         [[nodiscard]] inline bool match(const archetype_key& include) const {
             return (this->chunk_id == include.chunk_id
-                    && (include.signature & ~this->signature).none());
+                    && this->signature.contains(include.signature));
         }
 
         struct hasher {
@@ -52,23 +106,184 @@ namespace ant {
         };
     };
 
+    /**
+     * @brief archetype reached from another by adding or removing a
+     *        component
+     */
+    struct archetype_edge {
+        component_id_t component_id;
+        archetype* target;
+    };
+
     struct archetype {
-        const archetype_key key;
+        // only the chunk id changes, when the archetype_map retags it
+        archetype_key key;
+        // components stored in a column, tags are only in key.signature
         const component_id_list component_ids;
-        std::unordered_map<component_id_t, size_t> component_id_index;
-        std::vector<byte_array> byte_arrays;
-        std::vector<entity_t> entities;
+        // column of each component indexed by component id, _no_column for
+        // the ids below the highest one that the archetype doesn't have.
+        // empty when that id reaches _dense_column_limit
+        const std::vector<uint16_t> column_index;
+        std::pmr::vector<byte_array> byte_arrays;
+        std::pmr::vector<entity_t> entities;
+        storage_policy policy = storage_policy::contiguous;
+        size_t block_shift = _contiguous_block_shift;
+        // archetypes reached by adding / removing a component, sorted by
+        // component id and filled lazily by the archetype_map. only the
+        // transitions taken are stored, whatever the number of components
+        std::vector<archetype_edge> add_edges;
+        std::vector<archetype_edge> remove_edges;
+        // stable identifier given by the archetype_map, reused once the
+        // archetype is deleted
+        archetype_id_t id = 0;
+        // epoch its rows were last added, removed, reordered or retagged
+        uint64_t structure_epoch = 0;
+
+        /**
+         * @brief column of the component, _no_column if the archetype doesn't
+         *        have it
+         */
+        [[nodiscard]] inline size_t find_column(
+            component_id_t component_id) const noexcept {
+            if (component_id < column_index.size()) {
+                return column_index[component_id];
+            }
+            if (!column_index.empty() || component_ids.empty()) {
+                return _no_column;
+            }
+            auto it = std::lower_bound(component_ids.begin(),
+                                       component_ids.end(), component_id);
+            return it != component_ids.end() && *it == component_id
+                       ? static_cast<size_t>(it - component_ids.begin())
+                       : _no_column;
+        }
+
+        /**
+         * @brief column of the component
+         * @throw std::out_of_range if the archetype doesn't have it
+         */
+        [[nodiscard]] inline size_t column(component_id_t component_id) const {
+            const size_t column = find_column(component_id);
+            if (column == _no_column) [[unlikely]] {
+                throw std::out_of_range("component not in archetype");
+            }
+            return column;
+        }
+
+        [[nodiscard]] inline size_t block_capacity() const {
+            return size_t{1} << block_shift;
+        }
+
+        [[nodiscard]] inline size_t block_count() const {
+            return (entities.size() + block_capacity() - 1) >> block_shift;
+        }
+
+        /**
+         * @brief rows of the block are [block_begin(block),block_end(block))
+         */
+        [[nodiscard]] inline size_t block_begin(size_t block) const {
+            return block << block_shift;
+        }
+
+        [[nodiscard]] inline size_t block_end(size_t block) const {
+            return std::min(block_begin(block) + block_capacity(),
+                            entities.size());
+        }
+
+        /**
+         * @brief whether any row of the column changed at or after since,
+         *        structural changes included
+         */
+        [[nodiscard]] inline bool block_written(size_t component_index,
+                                                size_t block,
+                                                uint64_t since) const {
+            const auto& written = byte_arrays[component_index].written;
+            return structure_epoch >= since
+                   || (block < written.size() && written[block] >= since);
+        }
+
+        /**
+         * @brief address of the component of the given column at given row
+         */
+        [[nodiscard]] inline std::byte* get_data(size_t component_index,
+                                                 size_t index,
+                                                 size_t component_size) {
+            return byte_arrays[component_index].blocks[index >> block_shift]
+                   + (index & (block_capacity() - 1)) * component_size;
+        }
+    };
+
+    /**
+     * @brief archetypes matching a key, kept up to date by the archetype_map
+     *        as archetypes are created and deleted
+     */
+    struct query_state {
+        archetype_key include;
+        std::vector<archetype*> archetypes;
+
+        [[nodiscard]] inline bool match(const archetype_key& key) const {
+            return key.match(include);
+        }
     };
 
     template <typename... Cs>
     inline auto get_signature() {
-        return signature_t{((get_type_signature<Cs>()) |= ...)};
+        signature_t signature;
+        (
+            [&] {
+                for (component_id_t component_id : column_ids<Cs>()) {
+                    signature.set(component_id);
+                }
+            }(),
+            ...);
+        return signature;
     }
 
+    /**
+     * @brief components the parameters of a for_each callable require,
+     *        pointer parameters are optional and left out, as are sparse
+     *        components which no archetype holds
+     */
     template <typename Entity_T, typename... Cs>
     requires(std::is_same_v<Entity_T, entity_t>) inline auto get_signature(
         type_list<Entity_T, Cs...> types) {
-        return get_signature<Cs...>();
+        signature_t signature;
+        (
+            [&]<typename C>() {
+                using arg = std::remove_cvref_t<C>;
+                if constexpr (is_soa_ref_v<arg>) {
+                    signature |= get_signature<typename arg::value_type>();
+                } else if constexpr (!std::is_pointer_v<arg>
+                                     && !sparse_component<arg>) {
+                    signature.set(type_id_generator::get<C>());
+                }
+            }.template operator()<Cs>(),
+            ...);
+        return signature;
+    }
+
+    /**
+     * @brief whether the parameters of a for_each callable take sparse
+     *        components, which for_each joins entity by entity
+     */
+    template <typename Args>
+    inline constexpr bool sparse_arguments_v = false;
+
+    template <typename Entity_T, typename... Cs>
+    inline constexpr bool sparse_arguments_v<type_list<Entity_T, Cs...>>
+        = any_sparse_v<std::remove_pointer_t<std::remove_cvref_t<Cs>>...>;
+
+    /**
+     * @brief components spanned by the parameters of a for_each_span
+     *        callable, std::span<const entity_t> then std::span<Cs>...
+     */
+    template <typename Entities, typename... Spans>
+    inline auto span_signature(type_list<Entities, Spans...>) {
+        static_assert(
+            !any_sparse_v<typename std::remove_cvref_t<Spans>::element_type...>,
+            "sparse components can't be spanned");
+        return get_signature<
+            typename std::remove_cvref_t<Spans>::element_type...>();
     }
 
 }  // namespace ant
\ No newline at end of file
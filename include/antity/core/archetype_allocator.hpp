@@ -5,14 +5,24 @@
 namespace ant {
     class archetype_allocator {
        public:
+        archetype_allocator(std::pmr::memory_resource* resource)
+            : resource_(resource) {}
+
         /**
-         * \brief allocate memory if needed exponential allocation
+         * \brief allocate memory if needed exponential allocation for
+         * contiguous archetypes, one more block for chunked archetypes
          * \param archetype
          * \param component_index
          * \param component
          */
         void auto_allocate(archetype* archetype, size_t component_index,
                            component_base* component) {
+            if (archetype->policy == storage_policy::chunked) {
+                if (needs_block(archetype, component_index)) {
+                    append_block(archetype, component_index, component);
+                }
+                return;
+            }
             if (needs_space(archetype, component_index, component->get_size())) {
                 double_allocation(archetype, component_index, component);
             }
@@ -26,12 +36,74 @@ namespace ant {
          */
         void auto_shrink(archetype* archetype, size_t component_index,
                          component_base* component) {
+            if (!archetype->byte_arrays[component_index].owned) {
+                // releasing borrowed memory would only cost a copy
+                return;
+            }
+            if (archetype->policy == storage_policy::chunked) {
+                release_spare_blocks(archetype, component_index, component);
+                return;
+            }
             if (needs_shrinking(archetype, component_index,
                               component->get_size())) {
                 shrink_to_fit(archetype, component_index, component);
             }
         }
 
+        /**
+         * \brief make room for rows components in the given column at once
+         * \param archetype
+         * \param component_index
+         * \param component
+         * \param rows total number of rows the column must be able to hold
+         */
+        void reserve(archetype* archetype, size_t component_index,
+                     component_base* component, size_t rows) {
+            auto& byte_array = archetype->byte_arrays[component_index];
+            if (archetype->policy == storage_policy::chunked) {
+                while ((byte_array.blocks.size() << archetype->block_shift)
+                       < rows) {
+                    append_block(archetype, component_index, component);
+                }
+                return;
+            }
+            if (byte_array.size < rows * component->get_size()) {
+                resize(archetype, component_index, component,
+                       rows * component->get_size());
+            }
+        }
+
+        /**
+         * \brief free every block of the given column, components have to be
+         * destroyed beforehand
+         */
+        void deallocate(archetype* archetype, size_t component_index,
+                        component_base* component) {
+            auto& byte_array = archetype->byte_arrays[component_index];
+            if (byte_array.owned) {
+                for (auto* block : byte_array.blocks) {
+                    component->deallocate(resource_, block, byte_array.size);
+                }
+            }
+            byte_array.blocks.clear();
+            byte_array.size = 0;
+            byte_array.owned = true;
+        }
+
+        /**
+         * \brief use memory the archetype doesn't own as the single block of
+         * an empty contiguous column. the memory has to outlive the column or
+         * the next resize, which copies the components out of it
+         * \param data at least size bytes aligned for the component
+         */
+        void borrow(archetype* archetype, size_t component_index,
+                    std::byte* data, size_t size) {
+            auto& byte_array = archetype->byte_arrays[component_index];
+            byte_array.blocks.assign(1, data);
+            byte_array.size = size;
+            byte_array.owned = false;
+        }
+
        private:
         void double_allocation(archetype* archetype, size_t component_index,
                               component_base* component) {
@@ -48,18 +120,21 @@ namespace ant {
 
         void resize(archetype* archetype, size_t component_index,
                     component_base* component, size_t newSize) {
-            size_t componentSize = component->get_size();
-            auto* newData = component->allocate(newSize);
-            for (std::size_t e = 0; e < archetype->entities.size(); ++e) {
-                component->move_data(&archetype->byte_arrays[component_index]
-                                          .componentData[e * componentSize],
-                                     &newData[e * componentSize]);
-                component->destroy_data(&archetype->byte_arrays[component_index]
-                                             .componentData[e * componentSize]);
+            auto& byte_array = archetype->byte_arrays[component_index];
+            auto* newData = component->allocate(resource_, newSize);
+            if (!byte_array.blocks.empty()) {
+                component->relocate_n(byte_array.blocks[0], newData,
+                                      archetype->entities.size());
+                if (byte_array.owned) {
+                    component->deallocate(resource_, byte_array.blocks[0],
+                                          byte_array.size);
+                }
+                byte_array.blocks[0] = newData;
+                byte_array.owned = true;
+            } else {
+                byte_array.blocks.push_back(newData);
             }
-            delete[] archetype->byte_arrays[component_index].componentData;
-            archetype->byte_arrays.at(component_index).size = newSize;
-            archetype->byte_arrays[component_index].componentData = newData;
+            byte_array.size = newSize;
         }
 
         bool needs_space(archetype* archetype, size_t component_index,
@@ -74,8 +149,39 @@ namespace ant {
                            size_t componentSize) {
             size_t allocated = archetype->byte_arrays.at(component_index).size;
             size_t used = archetype->entities.size() * componentSize;
-            return allocated > used / 2;
+            return allocated > used * 4;
+        }
+
+        bool needs_block(archetype* archetype, size_t component_index) {
+            return (archetype->entities.size() >> archetype->block_shift)
+                   >= archetype->byte_arrays[component_index].blocks.size();
         }
+
+        void append_block(archetype* archetype, size_t component_index,
+                          component_base* component) {
+            auto& byte_array = archetype->byte_arrays[component_index];
+            byte_array.size
+                = archetype->block_capacity() * component->get_size();
+            byte_array.blocks.push_back(
+                component->allocate(resource_, byte_array.size));
+        }
+
+        /**
+         * \brief keeps one spare block so that an entity going back and forth
+         * at a block boundary doesn't allocate each time
+         */
+        void release_spare_blocks(archetype* archetype,
+                                  size_t component_index,
+                                  component_base* component) {
+            auto& byte_array = archetype->byte_arrays[component_index];
+            while (byte_array.blocks.size() > archetype->block_count() + 1) {
+                component->deallocate(resource_, byte_array.blocks.back(),
+                                      byte_array.size);
+                byte_array.blocks.pop_back();
+            }
+        }
+
+        std::pmr::memory_resource* resource_;
     };
 
 }  // namespace ant
@@ -2,124 +2,131 @@
 #include <antity/core/archetype.hpp>
 #include <antity/core/archetype_allocator.hpp>
 #include <antity/core/component.hpp>
+#include <antity/core/filter.hpp>
 #include <antity/core/record.hpp>
-#include <antity/core/registry.hpp>
 #include <antity/utility/function_traits.hpp>
+#include <algorithm>
+#include <array>
+#include <new>
 #include <ranges>
+#include <span>
+#include <tuple>
 
 namespace ant {
     class archetype_handler {
        public:
         archetype_handler(entity_index* entity_index,
-                          component_map* component_map_)
-            : entity_index_(entity_index), component_map_(component_map_) {}
+                          component_map* component_map_,
+                          std::pmr::memory_resource* resource)
+            : archetype_allocator_(resource),
+              entity_index_(entity_index),
+              component_map_(component_map_) {}
 
         /**
-         * @brief emplacing component in the given archetype's byte_arrays
+         * @brief make room for rows entities in every column of the archetype
          *
-         * @tparam C type of the component being created
-         * @tparam Args arguments to create the component of type C
-         * @param archetype archetype the component has to be emplaced in
-         * @param component_index index of the component being created in the
-         * byte_arrays
-         * @param args arguments that are forwared to component Ctor
-         */
-        template <typename C, typename... Args>
-        void emplace_component(archetype* archetype, size_t component_index,
-                               Args... args) {
-            archetype_allocator_.auto_allocate(
-                archetype, component_index,
-                component_map_->at(type_id_generator::get<C>()).get());
-            C* newComponent = new (
-                &archetype->byte_arrays[component_index]
-                     .componentData[archetype->entities.size() * sizeof(C)])
-                C(std::forward<Args>(args)...);
+         * @param archetype archetype to grow
+         * @param rows total number of entities the archetype must hold
+         */
+        void reserve(archetype* archetype, size_t rows) {
+            for (size_t i = 0; i < archetype->byte_arrays.size(); i++) {
+                archetype_allocator_.reserve(
+                    archetype, i,
+                    component_map_->at(archetype->component_ids[i]).get(),
+                    rows);
+            }
+            archetype->entities.reserve(rows);
         }
 
         template <typename C>
         void insert_component(archetype* archetype, C&& c) {
-            size_t component_index{
-                archetype->component_id_index.at(type_id_generator::get<C>())};
-            archetype_allocator_.auto_allocate(
-                archetype, component_index,
-                component_map_->at(type_id_generator::get<C>()).get());
-            C* newComponent = new (
-                &archetype->byte_arrays[component_index]
-                     .componentData[archetype->entities.size() * sizeof(C)])
-                C(std::forward<C>(c));
+            using component = std::remove_cvref_t<C>;
+            if constexpr (soa_component<component>) {
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    (insert_component(
+                         archetype, soa_field<component, Is>{
+                                        c.*soa_member<component, Is>}),
+                     ...);
+                }(std::make_index_sequence<soa_field_count<component>>{});
+            } else if constexpr (!is_tag_v<component>) {
+                size_t component_index{
+                    archetype->column(type_id_generator::get<C>())};
+                archetype_allocator_.auto_allocate(
+                    archetype, component_index,
+                    component_map_->at(type_id_generator::get<C>()).get());
+                C* newComponent = new (archetype->get_data(
+                    component_index, archetype->entities.size(), sizeof(C)))
+                    C(std::forward<C>(c));
+                mark_added(archetype, component_index,
+                           archetype->entities.size(),
+                           archetype->entities.size() + 1);
+            }
         }
 
         /**
-         * @brief move last component of given archetype
+         * @brief copy constructs value in the rows [first, first + count) of
+         *        its column, of the columns of its fields for a soa
+         *        component. the rows have to be allocated
          *
-         * @param archetype ptr to the archetype containing the component that
-         * needs to be moved
-         * @param to_index (entity) index that the component has to be moved to
-         * @param component_index index of the component type in the byte_arrays
-         * @param component ptr to the base_component being moved
+         * @param built rows constructed so far per column, incremented as
+         *        each row is, so that a throwing copy can be rolled back
          */
-        void move_last_component(archetype* archetype, size_t to_index,
-                                 size_t component_index,
-                                 component_base* component) {
-            move_component(archetype, archetype, archetype->entities.size() - 1,
-                           to_index, component_index, component_index,
-                           component);
+        template <typename C>
+        void construct_rows(archetype* archetype, size_t first, size_t count,
+                            const C& value, std::span<size_t> built) {
+            if constexpr (soa_component<C>) {
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    (construct_rows(archetype, first, count,
+                                    soa_field<C, Is>{value.*soa_member<C, Is>},
+                                    built),
+                     ...);
+                }(std::make_index_sequence<soa_field_count<C>>{});
+            } else if constexpr (!is_tag_v<C>) {
+                const size_t column
+                    = archetype->column(type_id_generator::get<C>());
+                for (size_t row = first; row < first + count; ++row) {
+                    new (archetype->get_data(column, row, sizeof(C)))
+                        C(value);
+                    ++built[column];
+                }
+            }
         }
 
         /**
-         * @brief move component from one archetype to another
-         *
-         * @param from ptr to the archetype currently holding the component
-         * @param to ptr to the archetype component has to be moved to
-         * @param from_index index of the entity containing the component in the
-         * old archetype
-         * @param to_index index of that the entity will be moved to in the new
-         * archetype
-         * @param old_component_index index of the component_type in the old
-         * archetype byte_arrays
-         * @param new_component_index index of the component_type in the new
-         * archetype byte_arrays
-         * @param component ptr to the base_component being moved
-         */
-        void move_component(archetype* from, archetype* to, size_t from_index,
-                            size_t to_index, size_t old_component_index,
-                            size_t new_component_index,
-                            component_base* component) {
-            if (from != to) {
-                archetype_allocator_.auto_allocate(to, new_component_index,
-                                                   component);
-            }
-            size_t componentSize = component->get_size();
-            component->move_data(
-                &from->byte_arrays[old_component_index]
-                     .componentData[from_index * componentSize],
-                &to->byte_arrays[new_component_index]
-                     .componentData[to_index * componentSize]);
-            component->destroy_data(
-                &from->byte_arrays[old_component_index]
-                     .componentData[from_index * componentSize]);
-        }
-
-        /**
-         * @brief erase component of given archetype and entity index
-         * effectively calling dtor shrinking component arrays if necessary
-         *
-         * @param archetype ptr to the archetype containing the component to
-         * delete
-         * @param index the index of the entity that component needs to be
-         * removed
-         * @param component_index index of the component type in the byte_arrays
-         * @param component ptr to the component_base needed to call correct
-         * dtor
+         * @brief replace the C held at row by value, for components that are
+         *        neither move assignable nor nothrow move constructible.
+         *        value is moved into the row past the last one first, so a
+         *        move that throws leaves the held C untouched. the held C is
+         *        only destroyed after that, and the staged value is then
+         *        relocated into its row like in any migration
          */
-        void erase_component(archetype* archetype, const size_t index,
-                             size_t component_index,
-                             component_base* component) {
-            component->destroy_data(
-                &archetype->byte_arrays[component_index]
-                     .componentData[index * component->get_size()]);
-            archetype_allocator_.auto_shrink(archetype, component_index,
-                                             component);
+        template <typename C>
+        void replace_through_fresh_row(archetype* archetype, size_t row,
+                                       C& value) {
+            const component_id_t component_id = type_id_generator::get<C>();
+            component_base* component = component_map_->at(component_id).get();
+            const size_t column = archetype->column(component_id);
+            const size_t fresh = archetype->entities.size();
+            archetype_allocator_.reserve(archetype, column, component,
+                                         fresh + 1);
+            std::byte* staged = archetype->get_data(column, fresh, sizeof(C));
+            new (staged) C(std::move(value));
+            std::byte* held = archetype->get_data(column, row, sizeof(C));
+            component->destroy_data(held);
+            component->relocate_n(staged, held, 1);
+            mark_written(archetype, column, row, row + 1);
+        }
+
+        /**
+         * @brief destroy the rows [first, first + built[j]) of every column j,
+         *        undoes construct_rows
+         */
+        void destroy_built(archetype* archetype, size_t first,
+                           std::span<const size_t> built) {
+            for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
+                destroy_rows(archetype, archetype->component_ids[j], first,
+                             first + built[j]);
+            }
         }
 
         /**
@@ -132,83 +139,505 @@ namespace ant {
             for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
                 auto component
                     = component_map_->at(archetype->component_ids[j]).get();
-                for (size_t i = 0; i < archetype->entities.size(); i++) {
-                    component->destroy_data(
-                        &archetype->byte_arrays[j]
-                             .componentData[i * component->get_size()]);
+                for (size_t block = 0; block < archetype->block_count();
+                     ++block) {
+                    component->destroy_n(archetype->byte_arrays[j].blocks[block],
+                                         archetype->block_end(block)
+                                             - archetype->block_begin(block));
                 }
-                delete[] archetype->byte_arrays[j].componentData;
-                archetype->byte_arrays[j].size = 0;
+                archetype_allocator_.deallocate(archetype, j, component);
             }
         }
 
+        /**
+         * @brief destroy the components of the entity at given row, the last
+         *        entity of the archetype takes its place
+         *
+         * @param archetype archetype holding the entity
+         * @param index row of the entity
+         */
+        void erase_entity(archetype* archetype, size_t index) {
+            const size_t last = archetype->entities.size() - 1;
+            for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
+                component_base* component
+                    = component_map_->at(archetype->component_ids[j]).get();
+                const size_t size = component->get_size();
+                std::byte* data = archetype->get_data(j, index, size);
+                component->destroy_data(data);
+                if (index != last) {
+                    component->relocate_n(archetype->get_data(j, last, size),
+                                          data, 1);
+                    carry_ticks(archetype, j, last, archetype, j, index);
+                }
+            }
+            try_move_last_entity_to(archetype, index);
+            archetype->entities.pop_back();
+            shrink(archetype);
+        }
+
+        /**
+         * @brief destroy the components of the entities at given rows and
+         *        compact the archetype in a single pass, surviving entities
+         *        from the tail of the archetype fill the holes
+         *
+         * @param archetype archetype holding the entities
+         * @param rows sorted rows of the entities to erase, without duplicates
+         */
+        void erase_entities(archetype* archetype,
+                            const std::vector<size_t>& rows) {
+            if (rows.empty()) {
+                return;
+            }
+            const size_t count = archetype->entities.size();
+            const size_t new_count = count - rows.size();
+
+            std::vector<size_t> holes;
+            std::vector<size_t> survivors;
+            auto erased = rows.begin();
+            for (; erased != rows.end() && *erased < new_count; ++erased) {
+                holes.push_back(*erased);
+            }
+            for (size_t row = new_count; row < count; ++row) {
+                if (erased != rows.end() && *erased == row) {
+                    ++erased;
+                    continue;
+                }
+                survivors.push_back(row);
+            }
+
+            for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
+                component_base* component
+                    = component_map_->at(archetype->component_ids[j]).get();
+                const size_t size = component->get_size();
+                for (auto row : rows) {
+                    component->destroy_data(archetype->get_data(j, row, size));
+                }
+                for (size_t k = 0; k < holes.size(); k++) {
+                    component->relocate_n(
+                        archetype->get_data(j, survivors[k], size),
+                        archetype->get_data(j, holes[k], size), 1);
+                    carry_ticks(archetype, j, survivors[k], archetype, j,
+                                holes[k]);
+                }
+            }
+            for (size_t k = 0; k < holes.size(); k++) {
+                const entity_t survivor = archetype->entities[survivors[k]];
+                archetype->entities[holes[k]] = survivor;
+                (*entity_index_)[survivor].index = holes[k];
+            }
+            archetype->entities.resize(new_count);
+            touch(archetype);
+            shrink(archetype);
+        }
+
+        /**
+         * @brief column mapping between two archetypes, computed once for
+         *        all the entities moving from one to the other
+         */
+        struct migration_plan {
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            archetype* from;
+            archetype* to;
+            std::vector<component_base*> from_components{};
+            std::vector<component_base*> to_components{};
+            // column of from holding each column of to, npos if absent
+            std::vector<size_t> from_columns{};
+            // whether each column of from is present in to
+            std::vector<bool> kept{};
+        };
+
+        /**
+         * @param from archetype the entities leave, nullptr if they have no
+         *        component
+         * @param to archetype the entities move to, nullptr if they end up
+         *        without components
+         */
+        migration_plan plan_migration(archetype* from, archetype* to) {
+            migration_plan plan{from, to};
+            if (from) {
+                plan.kept.resize(from->byte_arrays.size());
+                for (auto component_id : from->component_ids) {
+                    plan.from_components.push_back(
+                        component_map_->at(component_id).get());
+                }
+            }
+            if (to) {
+                for (auto component_id : to->component_ids) {
+                    plan.to_components.push_back(
+                        component_map_->at(component_id).get());
+                    const size_t column
+                        = from ? from->find_column(component_id) : _no_column;
+                    if (column != _no_column) {
+                        plan.from_columns.push_back(column);
+                        plan.kept[column] = true;
+                    } else {
+                        plan.from_columns.push_back(migration_plan::npos);
+                    }
+                }
+            }
+            return plan;
+        }
+
+        /**
+         * @brief move the entity at given row of plan.from to the end of
+         *        plan.to, the last entity of from takes its place. components
+         *        of to that value returns a non null source for are relocated
+         *        from it, the others from from. components of from missing in
+         *        to or replaced are destroyed. columns of to have to be
+         *        reserved beforehand, from isn't shrunk
+         *
+         * @param plan mapping from plan_migration
+         * @param row row of the entity in from
+         * @param value callable taking a component_id_t, returning the
+         *        std::byte* of a new value for that component or nullptr
+         */
+        template <typename Values>
+        void migrate_entity(const migration_plan& plan, size_t row,
+                            Values&& value) {
+            archetype* from = plan.from;
+            archetype* to = plan.to;
+            const size_t to_row = to ? to->entities.size() : 0;
+            for (size_t i = 0; to && i < to->byte_arrays.size(); i++) {
+                component_base* component = plan.to_components[i];
+                const size_t size = component->get_size();
+                std::byte* destination = to->get_data(i, to_row, size);
+                const size_t from_index = plan.from_columns[i];
+                std::byte* source = value(to->component_ids[i]);
+                if (source) {
+                    if (from_index != migration_plan::npos) {
+                        component->destroy_data(
+                            from->get_data(from_index, row, size));
+                        mark_written(to, i, to_row, to_row + 1);
+                    } else {
+                        mark_added(to, i, to_row, to_row + 1);
+                    }
+                } else {
+                    source = from->get_data(from_index, row, size);
+                    carry_ticks(from, from_index, row, to, i, to_row);
+                }
+                component->relocate_n(source, destination, 1);
+            }
+            if (from == nullptr) {
+                return;
+            }
+            const size_t last = from->entities.size() - 1;
+            for (size_t j = 0; j < from->byte_arrays.size(); j++) {
+                component_base* component = plan.from_components[j];
+                const size_t size = component->get_size();
+                std::byte* data = from->get_data(j, row, size);
+                if (!plan.kept[j]) {
+                    component->destroy_data(data);
+                }
+                if (row != last) {
+                    component->relocate_n(from->get_data(j, last, size), data,
+                                          1);
+                    carry_ticks(from, j, last, from, j, row);
+                }
+            }
+            try_move_last_entity_to(from, row);
+            from->entities.pop_back();
+        }
+
+        /**
+         * @brief relocate every entity of from at the end of to, in runs
+         *        bounded by the blocks of both archetypes. they must have the
+         *        same components, from is left empty
+         */
+        void append_entities(archetype* to, archetype* from) {
+            const size_t count = from->entities.size();
+            const size_t first = to->entities.size();
+            reserve(to, first + count);
+            for (size_t j = 0; j < from->byte_arrays.size(); j++) {
+                component_base* component
+                    = component_map_->at(from->component_ids[j]).get();
+                const size_t size = component->get_size();
+                for (size_t row = 0; row < count;) {
+                    const size_t run = std::min(
+                        {count - row, rows_left_in_block(from, row),
+                         rows_left_in_block(to, first + row)});
+                    component->relocate_n(from->get_data(j, row, size),
+                                          to->get_data(j, first + row, size),
+                                          run);
+                    carry_ticks(from, j, row, to, j, first + row);
+                    row += run;
+                }
+            }
+            for (size_t row = 0; row < count; row++) {
+                const entity_t entity = from->entities[row];
+                record_t& record = (*entity_index_)[entity];
+                record.entity_archetype = to;
+                record.index = static_cast<index_t>(first + row);
+                to->entities.push_back(entity);
+            }
+            from->entities.clear();
+            touch(to);
+            touch(from);
+        }
+
+        /**
+         * @brief write the components of every row, column by column in
+         *        component id order, each column block by block
+         */
+        void write_columns(std::ostream& out, archetype* archetype) {
+            for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
+                write_column(out, archetype, j);
+            }
+        }
+
+        /**
+         * @brief write the components of every row of the j-th column
+         */
+        void write_column(std::ostream& out, archetype* archetype, size_t j) {
+            component_base* component
+                = component_map_->at(archetype->component_ids[j]).get();
+            for (size_t block = 0; block < archetype->block_count(); ++block) {
+                component->serialize(out, archetype->byte_arrays[j].blocks[block],
+                                     archetype->block_end(block)
+                                         - archetype->block_begin(block));
+            }
+        }
+
+        /**
+         * @brief write the components of the rows of a block of the j-th
+         *        column
+         */
+        void write_block(std::ostream& out, archetype* archetype, size_t j,
+                         size_t block) {
+            component_map_->at(archetype->component_ids[j])
+                ->serialize(out, archetype->byte_arrays[j].blocks[block],
+                            archetype->block_end(block)
+                                - archetype->block_begin(block));
+        }
+
+        /**
+         * @brief replace the components of the rows of a block of the j-th
+         *        column by the output of write_block. on failure every row of
+         *        the archetype is destroyed and it's left empty
+         */
+        void read_block(std::istream& in, archetype* archetype, size_t j,
+                        size_t block) {
+            component_base* component
+                = component_map_->at(archetype->component_ids[j]).get();
+            const size_t first = archetype->block_begin(block);
+            const size_t count = archetype->block_end(block) - first;
+            std::byte* data = archetype->byte_arrays[j].blocks[block];
+            component->destroy_n(data, count);
+            try {
+                component->deserialize(in, data, count);
+            } catch (...) {
+                for (size_t k = 0; k < archetype->byte_arrays.size(); k++) {
+                    if (k != j) {
+                        destroy_rows(archetype, archetype->component_ids[k],
+                                     archetype->entities.size());
+                        continue;
+                    }
+                    destroy_rows(archetype, archetype->component_ids[k],
+                                 first);
+                    for (size_t row = first + count;
+                         row < archetype->entities.size(); row++) {
+                        component->destroy_data(
+                            archetype->get_data(k, row, component->get_size()));
+                    }
+                }
+                archetype->entities.clear();
+                throw;
+            }
+            mark_written(archetype, j, first, first + count);
+        }
+
+        /**
+         * @brief destroy every row of the archetype, records aren't updated
+         */
+        void clear_rows(archetype* archetype) {
+            for (component_id_t component_id : archetype->component_ids) {
+                destroy_rows(archetype, component_id,
+                             archetype->entities.size());
+            }
+            archetype->entities.clear();
+            touch(archetype);
+        }
+
+        /**
+         * @brief make the column of component_id of an empty contiguous
+         *        archetype point to size bytes of trivially copyable
+         *        components it doesn't own, see archetype_allocator::borrow
+         */
+        void borrow_column(archetype* archetype, component_id_t component_id,
+                           std::byte* data, size_t size) {
+            const size_t column = archetype->column(component_id);
+            archetype_allocator_.deallocate(
+                archetype, column, component_map_->at(component_id).get());
+            archetype_allocator_.borrow(archetype, column, data, size);
+            mark_added(archetype, column, 0,
+                       size / component_map_->at(component_id)->get_size());
+        }
+
+        /**
+         * @brief construct the rows [0, count) of the columns of the given
+         *        components, in that order, from the output of write_columns.
+         *        the columns have to be reserved and the archetype empty, on
+         *        failure the components read so far are destroyed
+         */
+        void read_columns(std::istream& in, archetype* archetype,
+                          const std::vector<component_id_t>& component_ids,
+                          size_t count) {
+            size_t done = 0;
+            size_t row = 0;
+            try {
+                for (; done < component_ids.size(); ++done) {
+                    const size_t column = archetype->column(component_ids[done]);
+                    component_base* component
+                        = component_map_->at(component_ids[done]).get();
+                    for (row = 0; row < count;) {
+                        const size_t run = std::min(
+                            count - row, rows_left_in_block(archetype, row));
+                        component->deserialize(
+                            in,
+                            archetype->get_data(column, row,
+                                                component->get_size()),
+                            run);
+                        row += run;
+                    }
+                    mark_added(archetype, column, 0, count);
+                }
+            } catch (...) {
+                for (size_t k = 0; k <= done && k < component_ids.size(); ++k) {
+                    destroy_rows(archetype, component_ids[k],
+                                 k == done ? row : count);
+                }
+                throw;
+            }
+        }
+
+        /**
+         * @brief release the memory of the archetype columns that exceeds
+         *        what its entities need
+         */
+        void shrink(archetype* archetype) {
+            for (size_t j = 0; j < archetype->byte_arrays.size(); j++) {
+                archetype_allocator_.auto_shrink(
+                    archetype, j,
+                    component_map_->at(archetype->component_ids[j]).get());
+            }
+        }
+
+        /**
+         * @brief the last entity takes the row at destination_index, which
+         *        the caller pops
+         */
         void try_move_last_entity_to(archetype* archetype,
                                      size_t destination_index) {
+            touch(archetype);
             const auto last_entity_index = archetype->entities.size() - 1;
             if (last_entity_index != destination_index) {
                 const entity_t last_entity
                     = archetype->entities.at(last_entity_index);
                 archetype->entities.at(destination_index) = last_entity;
-                entity_index_->at(last_entity).index = destination_index;
+                (*entity_index_)[last_entity].index = destination_index;
             }
         }
 
         void move_entity_to_archetype(archetype* new_archetype,
                                       entity_t entity) {
-            entity_index_->at(entity).entity_archetype = new_archetype;
-            entity_index_->at(entity).index = new_archetype->entities.size();
+            record_t& record = (*entity_index_)[entity];
+            record.entity_archetype = new_archetype;
+            record.index = new_archetype->entities.size();
             new_archetype->entities.push_back(entity);
+            touch(new_archetype);
         }
 
-        template <typename C, typename... Args>
-        void move_old_comp_and_emplace_new(archetype* old_archetype,
-                                           archetype* new_archetype,
-                                           size_t old_index, Args&&... args) {
-            int old_component_index = 0;
-            for (int i = 0; i < new_archetype->byte_arrays.size(); i++) {
-                component_id_t component_type_id
-                    = new_archetype->component_ids.at(i);
-                component_base* component
-                    = component_map_->at(component_type_id).get();
-                if (component_type_id == type_id_generator::get<C>()) {
-                    emplace_component<C>(new_archetype, i,
-                                         std::forward<Args>(args)...);
-                    continue;
-                }
-                move_component(old_archetype, new_archetype, old_index,
-                               new_archetype->entities.size(),
-                               old_component_index, i, component);
-                if ((old_archetype->entities.size() - 1) != old_index) {
-                    move_last_component(old_archetype, old_index,
-                                        old_component_index, component);
-                }
-                old_component_index++;
+        /**
+         * @brief tag the rows of the archetype as added, removed or moved at
+         *        the current epoch
+         */
+        void touch(archetype* archetype) const noexcept {
+            archetype->structure_epoch = entity_index_->epoch();
+        }
+
+        /**
+         * @brief tag the blocks of the rows [first, last) as written at the
+         *        current epoch in the columns of the Cs that are non const
+         *        lvalue references, the types f is called with
+         */
+        template <typename... Cs>
+        void mark_written(archetype* archetype, size_t first, size_t last) {
+            if (first < last) {
+                (mark_column_written<Cs>(archetype, first, last), ...);
             }
         }
 
-        template <typename C>
-        void move_comp_to_and_omit(archetype* old_archetype,
-                                   archetype* new_archetype, size_t old_index) {
-            int new_component_index = 0;
-            size_t omited_component_index{
-                old_archetype->component_id_index.at(type_id_generator::get<C>())};
+        template <typename Entity_T, typename... Cs>
+        void mark_written(type_list<Entity_T, Cs...>, archetype* archetype,
+                          size_t first, size_t last) {
+            mark_written<Cs...>(archetype, first, last);
+        }
 
-            for (int i = 0; i < old_archetype->byte_arrays.size(); i++) {
-                component_base* component
-                    = component_map_->at(old_archetype->component_ids.at(i))
-                          .get();
-                if (i != omited_component_index && new_archetype) {
-                    move_component(old_archetype, new_archetype, old_index,
-                                   new_archetype->entities.size() - 1, i,
-                                   new_component_index, component);
-
-                    new_component_index++;
-                } else {
-                    erase_component(old_archetype, old_index, i, component);
+        void mark_written(archetype* archetype, size_t column, size_t first,
+                          size_t last) {
+            stamp(archetype->byte_arrays[column].written, archetype, first,
+                  last);
+        }
+
+        /**
+         * @brief tag the blocks of the rows [first, last) of the column as
+         *        holding components added at the current epoch, which counts
+         *        as a write too
+         */
+        void mark_added(archetype* archetype, size_t column, size_t first,
+                        size_t last) {
+            stamp(archetype->byte_arrays[column].written, archetype, first,
+                  last);
+            stamp(archetype->byte_arrays[column].added, archetype, first,
+                  last);
+        }
+
+        /**
+         * @brief calls f like apply, skipping the blocks some filter rejects
+         */
+        template <typename F, typename Entity_T, typename... Cs,
+                  typename... Filters>
+        requires(std::invocable<F, entity_t, Cs...>) void apply_filtered(
+            F&& f, type_list<Entity_T, Cs...> args_type, archetype* archetype,
+            const Filters&... filters) {
+            for (size_t block = 0; block < archetype->block_count(); ++block) {
+                if (!(accepts_block(filters, *archetype, block) && ...)) {
+                    continue;
                 }
-                if ((old_archetype->entities.size() - 1) != old_index) {
-                    move_last_component(old_archetype, old_index, i, component);
+                const size_t first = archetype->block_begin(block);
+                const size_t last = archetype->block_end(block);
+                mark_written<Cs...>(archetype, first, last);
+                apply_range(f, args_type, archetype, first, last);
+            }
+        }
+
+        /**
+         * @brief calls f(std::span<const entity_t>, std::span<Cs>...) once
+         *        per block the filters accept, with the rows of the block
+         */
+        template <typename F, typename Entities, typename... Spans,
+                  typename... Filters>
+        requires(std::invocable<F, std::span<const entity_t>, Spans...>) void
+            apply_spans(F&& f, type_list<Entities, Spans...>,
+                        archetype* archetype, const Filters&... filters) {
+            std::tuple<span_column<std::remove_cvref_t<Spans>>...> columns{
+                span_column<std::remove_cvref_t<Spans>>(archetype)...};
+            for (size_t block = 0; block < archetype->block_count(); ++block) {
+                if (!(accepts_block(filters, *archetype, block) && ...)) {
+                    continue;
                 }
+                const size_t first = archetype->block_begin(block);
+                const size_t count = archetype->block_end(block) - first;
+                mark_written<
+                    typename std::remove_cvref_t<Spans>::element_type&...>(
+                    archetype, first, first + count);
+                std::apply(
+                    [&](const auto&... column) {
+                        f(std::span<const entity_t>(
+                              archetype->entities.data() + first, count),
+                          column.make(archetype, block, count)...);
+                    },
+                    columns);
             }
         }
 
@@ -237,28 +666,355 @@ namespace ant {
          */
         template <typename C>
         C& get_component(archetype* arch, size_t index) {
-            size_t component_index{
-                arch->component_id_index.at(type_id_generator::get<C>())};
+            static_assert(!soa_component<C>,
+                          "soa components are only handed out by for_each "
+                          "and for_each_span");
+            if constexpr (is_tag_v<C>) {
+                if (!arch->key.signature.test(type_id_generator::get<C>()))
+                    [[unlikely]] {
+                    throw std::out_of_range("component not in archetype");
+                }
+                return tag_instance<std::remove_cv_t<C>>();
+            } else {
+                size_t component_index{
+                    arch->column(type_id_generator::get<C>())};
 
-            return *std::launder(
-                reinterpret_cast<C*>(&arch->byte_arrays[component_index]
-                                          .componentData[index * sizeof(C)]));
+                return *std::launder(reinterpret_cast<C*>(
+                    arch->get_data(component_index, index, sizeof(C))));
+            }
         }
 
         template <typename F, typename Entity_T, typename... Cs>
         requires(std::invocable<F, entity_t, Cs...>) void apply(
             F&& f, type_list<Entity_T, Cs...> args_type, archetype* archetype) {
-            auto tup = std::make_tuple(
-                get_component_array<std::remove_reference_t<Cs>>(archetype)...);
+            mark_written<Cs...>(archetype, 0, archetype->entities.size());
+            apply_range(std::forward<F>(f), args_type, archetype, 0,
+                        archetype->entities.size());
+        }
+
+        /**
+         * @brief calls f on the entities of the rows [first, last) of the
+         *        archetype, block by block. the rows aren't marked written
+         *        so that ranges of an archetype can run concurrently
+         */
+        template <typename F, typename Entity_T, typename... Cs>
+        requires(std::invocable<F, entity_t, Cs...>) void apply_range(
+            F&& f, type_list<Entity_T, Cs...> args_type, archetype* archetype,
+            size_t first, size_t last) {
+            const std::tuple<argument_column<Cs>...> columns{
+                argument_column<Cs>(archetype)...};
 
-            for (size_t i = 0; i < archetype->entities.size(); ++i) {
-                f(archetype->entities.at(i),
-                  std::get<decltype(get_component_array<std::remove_reference_t<Cs>>(archetype))>(tup)[i]...
-                   );
+            while (first < last) {
+                const size_t block = first >> archetype->block_shift;
+                const size_t block_first = archetype->block_begin(block);
+                const size_t block_last
+                    = std::min(archetype->block_end(block), last);
+                const entity_t* entities = archetype->entities.data();
+                // by value so that the block pointers live in registers
+                std::apply(
+                    [&](auto... column) {
+                        (column.load(archetype, block, block_first), ...);
+                        for (size_t i = first; i < block_last; ++i) {
+                            f(entities[i], column[i]...);
+                        }
+                    },
+                    columns);
+                first = block_last;
             }
         }
 
        private:
+        /**
+         * @brief column handed to a parameter of a for_each callable, C& or
+         *        C for references and values, C* for pointers, null when the
+         *        archetype lacks an optional component. every row of a tag
+         *        gets its tag_instance
+         */
+        template <typename Arg>
+        struct argument_column {
+            using element
+                = std::remove_pointer_t<std::remove_reference_t<Arg>>;
+            static constexpr bool optional
+                = std::is_pointer_v<std::remove_reference_t<Arg>>;
+            static constexpr bool tag = is_tag_v<element>;
+            static_assert(!soa_component<element>,
+                          "soa components are taken as soa_ref<C>");
+
+            explicit argument_column(archetype* arch)
+                : column(find(arch)) {}
+
+            static size_t find(archetype* arch) {
+                const component_id_t id = type_id_generator::get<element>();
+                if constexpr (tag) {
+                    // required tags are matched by the signature
+                    return !optional || arch->key.signature.test(id)
+                               ? 0
+                               : _no_column;
+                } else if constexpr (optional) {
+                    return arch->find_column(id);
+                } else {
+                    return arch->column(id);
+                }
+            }
+
+            void load(archetype* arch, size_t block,
+                      size_t block_first) noexcept {
+                first = block_first;
+                if constexpr (tag) {
+                    data = column == _no_column
+                               ? nullptr
+                               : &tag_instance<std::remove_cv_t<element>>();
+                } else {
+                    data = column == _no_column
+                               ? nullptr
+                               : std::launder(reinterpret_cast<element*>(
+                                   arch->byte_arrays[column].blocks[block]));
+                }
+            }
+
+            decltype(auto) operator[](size_t row) const noexcept {
+                if constexpr (tag && optional) {
+                    return data;
+                } else if constexpr (tag) {
+                    return (*data);
+                } else if constexpr (optional) {
+                    return data ? data + (row - first) : nullptr;
+                } else {
+                    return (data[row - first]);
+                }
+            }
+
+            // for tags 0 if the archetype has it, else _no_column
+            size_t column;
+            element* data = nullptr;
+            // row of data
+            size_t first = 0;
+        };
+
+        /**
+         * @brief first field of each column of the soa component C in the
+         *        block
+         */
+        template <typename C, size_t N>
+        static details::soa_pointers_t<C> soa_block(
+            archetype* arch, const std::array<size_t, N>& columns,
+            size_t block) noexcept {
+            using pointers = details::soa_pointers_t<C>;
+            return [&]<size_t... Is>(std::index_sequence<Is...>) {
+                return pointers{
+                    std::launder(reinterpret_cast<
+                                 std::tuple_element_t<Is, pointers>>(
+                        arch->byte_arrays[columns[Is]].blocks[block]))...};
+            }(std::make_index_sequence<N>{});
+        }
+
+        template <typename C>
+        static auto soa_columns(archetype* arch) {
+            const auto ids = column_ids<C>();
+            std::array<size_t, ids.size()> columns;
+            for (size_t i = 0; i < ids.size(); ++i) {
+                columns[i] = arch->column(ids[i]);
+            }
+            return columns;
+        }
+
+        template <typename C>
+        struct argument_column<soa_ref<C>> {
+            using pointers = typename soa_ref<C>::pointers;
+
+            explicit argument_column(archetype* arch)
+                : columns(soa_columns<std::remove_const_t<C>>(arch)) {}
+
+            void load(archetype* arch, size_t block,
+                      size_t block_first) noexcept {
+                first = block_first;
+                data = soa_block<C>(arch, columns, block);
+            }
+
+            soa_ref<C> operator[](size_t row) const noexcept {
+                return soa_ref<C>(std::apply(
+                    [&](auto*... fields) {
+                        return pointers{fields + (row - first)...};
+                    },
+                    data));
+            }
+
+            std::array<size_t, soa_field_count<std::remove_const_t<C>>>
+                columns;
+            pointers data;
+            size_t first = 0;
+        };
+
+        /**
+         * @brief column handed to a parameter of a for_each_span callable
+         */
+        template <typename S>
+        struct span_column;
+
+        template <typename T, size_t Extent>
+        struct span_column<std::span<T, Extent>> {
+            static_assert(!is_tag_v<T>,
+                          "tags have no column to span, filter on them");
+            static_assert(!soa_component<T>,
+                          "soa components are spanned as soa_span<C>");
+
+            explicit span_column(archetype* arch)
+                : column(arch->column(type_id_generator::get<T>())) {}
+
+            std::span<T> make(archetype* arch, size_t block,
+                              size_t count) const noexcept {
+                return std::span<T>(
+                    std::launder(reinterpret_cast<T*>(
+                        arch->byte_arrays[column].blocks[block])),
+                    count);
+            }
+
+            size_t column;
+        };
+
+        template <typename C>
+        struct span_column<soa_span<C>> {
+            explicit span_column(archetype* arch)
+                : columns(soa_columns<std::remove_const_t<C>>(arch)) {}
+
+            soa_span<C> make(archetype* arch, size_t block,
+                             size_t count) const noexcept {
+                return soa_span<C>(soa_block<C>(arch, columns, block), count);
+            }
+
+            std::array<size_t, soa_field_count<std::remove_const_t<C>>>
+                columns;
+        };
+
+        template <typename Filter>
+        static bool accepts_block(const Filter& filter, const archetype& arch,
+                                  size_t block) {
+            if constexpr (block_filter<Filter>) {
+                return filter.accepts(arch, block);
+            } else {
+                return true;
+            }
+        }
+
+        void stamp(std::vector<uint64_t>& epochs, archetype* archetype,
+                   size_t first, size_t last) {
+            if (first >= last) {
+                return;
+            }
+            const size_t first_block = first >> archetype->block_shift;
+            const size_t last_block = (last - 1) >> archetype->block_shift;
+            if (epochs.size() <= last_block) {
+                epochs.resize(last_block + 1, 0);
+            }
+            std::fill(epochs.begin() + first_block,
+                      epochs.begin() + last_block + 1, entity_index_->epoch());
+        }
+
+        /**
+         * @brief the epochs of the block of to_row cover the ones of the
+         *        block of from_row, so that relocating a row never hides a
+         *        change from a filter
+         */
+        static void carry_ticks(const archetype* from, size_t from_column,
+                                size_t from_row, archetype* to,
+                                size_t to_column, size_t to_row) {
+            const size_t from_block = from_row >> from->block_shift;
+            const size_t to_block = to_row >> to->block_shift;
+            if (from == to && from_block == to_block) {
+                return;
+            }
+            carry(from->byte_arrays[from_column].written, from_block,
+                  to->byte_arrays[to_column].written, to_block);
+            carry(from->byte_arrays[from_column].added, from_block,
+                  to->byte_arrays[to_column].added, to_block);
+        }
+
+        static void carry(const std::vector<uint64_t>& from, size_t from_block,
+                          std::vector<uint64_t>& to, size_t to_block) {
+            if (from_block >= from.size() || from[from_block] == 0) {
+                return;
+            }
+            if (to.size() <= to_block) {
+                to.resize(to_block + 1, 0);
+            }
+            to[to_block] = std::max(to[to_block], from[from_block]);
+        }
+
+        template <typename C>
+        void mark_fields_written(archetype* archetype, size_t first,
+                                 size_t last) {
+            for (component_id_t component_id : column_ids<C>()) {
+                mark_written(archetype, archetype->column(component_id),
+                             first, last);
+            }
+        }
+
+        template <typename C>
+        void mark_column_written(archetype* archetype, size_t first,
+                                 size_t last) {
+            using pointer = std::remove_reference_t<C>;
+            using pointee = std::remove_pointer_t<pointer>;
+            using arg = std::remove_cv_t<pointer>;
+            if constexpr (sparse_component<std::remove_pointer_t<arg>>) {
+                // stored outside of the archetypes
+            } else if constexpr (is_soa_ref_v<arg>) {
+                if constexpr (!std::is_const_v<typename arg::element_type>) {
+                    mark_fields_written<typename arg::value_type>(
+                        archetype, first, last);
+                }
+            } else if constexpr (soa_component<pointer>) {
+                // element of a soa_span
+                if constexpr (!std::is_const_v<pointer>) {
+                    mark_fields_written<pointer>(archetype, first, last);
+                }
+            } else if constexpr (std::is_pointer_v<pointer>) {
+                if constexpr (!std::is_const_v<pointee>) {
+                    const size_t column = archetype->find_column(
+                        type_id_generator::get<pointee>());
+                    if (column != _no_column) {
+                        mark_written(archetype, column, first, last);
+                    }
+                }
+            } else if constexpr (std::is_lvalue_reference_v<C>
+                                 && !std::is_const_v<pointer>
+                                 && !is_tag_v<pointer>) {
+                mark_written(archetype,
+                             archetype->column(type_id_generator::get<C>()),
+                             first, last);
+            }
+        }
+
+        /**
+         * @brief destroy the rows [0, count) of the component column
+         */
+        void destroy_rows(archetype* archetype, component_id_t component_id,
+                          size_t count) {
+            destroy_rows(archetype, component_id, 0, count);
+        }
+
+        /**
+         * @brief destroy the rows [first, last) of the component column
+         */
+        void destroy_rows(archetype* archetype, component_id_t component_id,
+                          size_t first, size_t last) {
+            const size_t column = archetype->column(component_id);
+            component_base* component = component_map_->at(component_id).get();
+            for (size_t row = first; row < last;) {
+                const size_t run
+                    = std::min(last - row, rows_left_in_block(archetype, row));
+                component->destroy_n(
+                    archetype->get_data(column, row, component->get_size()),
+                    run);
+                row += run;
+            }
+        }
+
+        static size_t rows_left_in_block(const archetype* archetype,
+                                         size_t row) {
+            return archetype->block_capacity()
+                   - (row & (archetype->block_capacity() - 1));
+        }
+
         archetype_allocator archetype_allocator_;
         entity_index* entity_index_;
         component_map* component_map_;
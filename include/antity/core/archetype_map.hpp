@@ -1,22 +1,31 @@
 #pragma once
 #include <algorithm>
 #include <antity/core/archetype.hpp>
+#include <antity/core/component.hpp>
 #include <antity/utility/robin_hood.hpp>
+#include <bit>
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 namespace ant {
+    /**
+     * @brief owns the archetypes, stored in a dense array scanned by views
+     *        and for_each, and indexed by key in a flat hashtable. removal
+     *        swaps the last archetype in place, archetype ids stay stable
+     *        through a slot indirection
+     */
     class archetype_map {
        public:
         using archetype_hashtable
-            = std::unordered_map<archetype_key, std::unique_ptr<archetype>,
-                                 archetype_key::hasher,
-                                 archetype_key::comparator>;
+            = robin_hood::unordered_flat_map<archetype_key, archetype_id_t,
+                                             archetype_key::hasher,
+                                             archetype_key::comparator>;
 
-        archetype_map(archetype_handler* handler)
-            : archetype_handler_(handler) {}
-
-        archetype_hashtable* get() { return &archetype_hashtable_; }
+        archetype_map(archetype_handler* handler, component_map* components,
+                      storage_config config = {})
+            : archetype_handler_(handler),
+              component_map_(components),
+              config_(config) {}
 
         /**
          * \brief get that match exactly the archetype_key
@@ -25,27 +34,64 @@ namespace ant {
          * \return archetype* requested archetype
          */
         archetype* get(const archetype_key& archetype_key) {
-            if (!archetype_hashtable_.contains(archetype_key)) {
-                create_archetype(archetype_key);
+            auto it = archetype_hashtable_.find(archetype_key);
+            if (it == archetype_hashtable_.end()) {
+                return create_archetype(archetype_key);
             }
-            return archetype_hashtable_.at(archetype_key).get();
+            return at(it->second);
         }
 
         /**
-         * @brief get and iterator to the first element of underlying
-         *        vector of signatures matching at list all components
-         *        of given signature_t
-         *
-         * @param match signature containing all required components
-         * @return auto iterator to fisrt matching element of the underlying
-         *         vector of signatures
+         * @brief archetype matching exactly the key, nullptr if there is none
+         */
+        archetype* find(const archetype_key& archetype_key) {
+            auto it = archetype_hashtable_.find(archetype_key);
+            return it == archetype_hashtable_.end() ? nullptr : at(it->second);
+        }
+
+        /**
+         * @brief archetype of the given id, which must be alive
+         */
+        archetype* at(archetype_id_t id) {
+            return archetypes_[slots_[id]].get();
+        }
+
+        /**
+         * @brief number of archetypes, empty ones included
+         */
+        size_t size() const { return archetypes_.size(); }
+
+        /**
+         * @brief archetype at position index of the dense array, positions
+         *        change when an archetype is deleted, ids don't
+         */
+        archetype* operator[](size_t index) { return archetypes_[index].get(); }
+
+        /**
+         * @brief keys of the dense array, in the same order as the archetypes
          */
-        auto signatures_begin(const archetype_key& match) {
-            return std::find_if(archetype_keys_.begin(),
-                                archetype_keys_.end(),
-                                [&](const archetype_key& key) {
-                                    return (match.signature & ~key.signature).none() && (match.chunk_id == key.chunk_id) ;
-                                });
+        const std::vector<archetype_key>& keys() const { return keys_; }
+
+        /**
+         * @brief calls f(archetype*) on every archetype matching include,
+         *        scanning the dense key array without hashing. archetypes
+         *        created by f aren't visited
+         */
+        template <typename F>
+        void for_each_matching(const archetype_key& include, F&& f) {
+            const size_t size = keys_.size();
+            size_t i = 0;
+            while (i < size) {
+                // tight scan, keys_ is only reloaded once f ran as it may
+                // create archetypes
+                const archetype_key* keys = keys_.data();
+                while (i < size && !keys[i].match(include)) {
+                    ++i;
+                }
+                if (i < size) {
+                    f(archetypes_[i++].get());
+                }
+            }
         }
 
         /**
@@ -55,34 +101,53 @@ namespace ant {
          * @tparam C component to add to the current archetype
          * @param current ptr to the current archetype
          * @return auto archetype containing all components of current archetype
-         * plus C
+         * plus C, current itself if it already holds C
          */
         template <typename C>
         archetype* get_next_archetype_add(archetype* current) {
+            const component_id_t component_id = type_id_generator::get<C>();
+            if (archetype* next = get_edge(current->add_edges, component_id)) {
+                return next;
+            }
+            if (current->key.signature.test(component_id)) {
+                // a self edge would send valid adds onto current
+                return current;
+            }
             signature_t new_archetype_signature
                 = add_type_to_signature<C>(current->key.signature);
-            return get({new_archetype_signature,current->key.chunk_id});
+            archetype* next
+                = get({new_archetype_signature, current->key.chunk_id});
+            link(current, next, component_id);
+            return next;
         }
 
+        /**
+         * @brief get next archetype obtained by removing given component
+         *
+         * @return archetype* nullptr if C was the last component, current
+         * itself if it doesn't hold C
+         */
         template <typename C>
         archetype* get_next_archetype_remove(archetype* current) {
+            const component_id_t component_id = type_id_generator::get<C>();
+            if (archetype* next
+                = get_edge(current->remove_edges, component_id)) {
+                return next;
+            }
+            if (!current->key.signature.test(component_id)) {
+                return current;
+            }
             signature_t new_archetype_signature
                 = remove_type_to_signature<C>(current->key.signature);
             if (new_archetype_signature.none()) {
                 return nullptr;
             }
-            return get({new_archetype_signature,current->key.chunk_id});
+            archetype* next
+                = get({new_archetype_signature, current->key.chunk_id});
+            link(next, current, component_id);
+            return next;
         }
 
-        /**
-         * @brief get and iterator to the last element of underlying
-         *        vector of signatures
-         *
-         * @return auto iterator to the last element of underlying
-         *        vector of signatures
-         */
-        auto signatures_end() { return archetype_keys_.end(); }
-
         /**
          * @brief deletes archetype associated with given key
          *        effectively cleaning it's component_arrays
@@ -90,42 +155,264 @@ namespace ant {
          * @param key archetype to be deleted
          */
         void delete_archetype(const archetype_key& key) {
-            archetype_handler_->clean_archetype_component_arrays(
-                archetype_hashtable_.at(key).get());
-            archetype_hashtable_.erase(key);
-            std::erase(archetype_keys_,key);
+            delete_archetype(archetype_hashtable_.at(key));
         }
 
-        void on_component_registration(component_id_t component_type_id) {}
+        void delete_archetype(archetype_id_t id) {
+            const size_t index = slots_[id];
+            archetype* deleted = archetypes_[index].get();
+            for_each_query([&](query_state& query) {
+                if (query.match(deleted->key)) {
+                    auto it = std::find(query.archetypes.begin(),
+                                        query.archetypes.end(), deleted);
+                    *it = query.archetypes.back();
+                    query.archetypes.pop_back();
+                }
+            });
+            unlink(deleted);
+            archetype_handler_->clean_archetype_component_arrays(deleted);
+            archetype_hashtable_.erase(deleted->key);
+
+            // swap remove, the last archetype takes the freed position
+            if (index != archetypes_.size() - 1) {
+                archetypes_[index] = std::move(archetypes_.back());
+                keys_[index] = std::move(keys_.back());
+                slots_[archetypes_[index]->id] = static_cast<uint32_t>(index);
+            }
+            archetypes_.pop_back();
+            keys_.pop_back();
+            free_ids_.push_back(id);
+        }
+
+        /**
+         * @brief archetypes whose key has the given chunk id
+         */
+        std::vector<archetype*> chunk_archetypes(chunk_id_t chunk_id) {
+            std::vector<archetype*> archetypes;
+            for (size_t i = 0; i < keys_.size(); ++i) {
+                if (keys_[i].chunk_id == chunk_id) {
+                    archetypes.push_back(archetypes_[i].get());
+                }
+            }
+            return archetypes;
+        }
+
+        /**
+         * @brief moves an archetype to another chunk keeping its components,
+         *        entities and id. no archetype of the same signature may
+         *        exist in that chunk. edges are kept, every archetype of a
+         *        chunk has to be retagged or deleted along with it
+         *
+         * @param arch archetype to move
+         * @param chunk_id chunk it ends up in
+         */
+        void retag(archetype* arch, chunk_id_t chunk_id) {
+            const archetype_key previous = arch->key;
+            archetype_hashtable_.erase(previous);
+            arch->key.chunk_id = chunk_id;
+            keys_[slots_[arch->id]].chunk_id = chunk_id;
+            archetype_hashtable_.emplace(arch->key, arch->id);
+            for_each_query([&](query_state& query) {
+                const bool matched = query.match(previous);
+                const bool matches = query.match(arch->key);
+                if (matched && !matches) {
+                    std::erase(query.archetypes, arch);
+                } else if (!matched && matches) {
+                    query.archetypes.push_back(arch);
+                }
+            });
+        }
+
+        /**
+         * @brief deletes every archetype along with its components
+         */
+        void clear() {
+            while (!archetypes_.empty()) {
+                delete_archetype(archetypes_.back()->id);
+            }
+        }
+
+        /**
+         * @brief archetypes are kept alive when their last entity leaves so
+         *        that their edges stay cached, this releases them
+         */
+        void delete_empty_archetypes() {
+            // backward so that swapped in archetypes were already visited
+            for (size_t i = archetypes_.size(); i-- > 0;) {
+                if (archetypes_[i]->entities.empty()) {
+                    delete_archetype(archetypes_[i]->id);
+                }
+            }
+        }
 
-        auto& get_keys() { return archetype_keys_;}
+        const storage_config& config() const { return config_; }
+
+        /**
+         * @brief build a query matching include, the archetype_map keeps it
+         *        up to date as long as the returned state is alive
+         *
+         * @param include components and chunk the archetypes must match
+         * @return std::shared_ptr<query_state> matching archetypes
+         */
+        std::shared_ptr<query_state> register_query(
+            const archetype_key& include) {
+            auto query = std::make_shared<query_state>(include);
+            for_each_matching(include, [&](archetype* arch) {
+                query->archetypes.push_back(arch);
+            });
+            queries_.push_back(query);
+            return query;
+        }
+
+        void on_component_registration(component_id_t component_type_id) {}
 
        private:
-        void create_archetype(const archetype_key& key) {
-            const component_id_list component_ids
-                = signature_to_type_ids(key.signature);
+        /**
+         * @brief first edge whose component id isn't lower than component_id
+         */
+        template <typename Edges>
+        static auto find_edge(Edges& edges, component_id_t component_id) {
+            return std::lower_bound(
+                edges.begin(), edges.end(), component_id,
+                [](const archetype_edge& edge, component_id_t id) {
+                    return edge.component_id < id;
+                });
+        }
+
+        static archetype* get_edge(const std::vector<archetype_edge>& edges,
+                                   component_id_t component_id) {
+            auto it = find_edge(edges, component_id);
+            return it != edges.end() && it->component_id == component_id
+                       ? it->target
+                       : nullptr;
+        }
+
+        static void set_edge(std::vector<archetype_edge>& edges,
+                             component_id_t component_id, archetype* target) {
+            auto it = find_edge(edges, component_id);
+            if (it != edges.end() && it->component_id == component_id) {
+                it->target = target;
+            } else {
+                edges.insert(it, archetype_edge{component_id, target});
+            }
+        }
+
+        static void erase_edge(std::vector<archetype_edge>& edges,
+                               component_id_t component_id) {
+            auto it = find_edge(edges, component_id);
+            if (it != edges.end() && it->component_id == component_id) {
+                edges.erase(it);
+            }
+        }
+
+        /**
+         * @brief edges are always stored in both directions, from + C = to
+         *        and to - C = from, so that deleting either can clear the
+         *        other one
+         */
+        static void link(archetype* from, archetype* to,
+                         component_id_t component_id) {
+            set_edge(from->add_edges, component_id, to);
+            set_edge(to->remove_edges, component_id, from);
+        }
 
+        static void unlink(archetype* deleted) {
+            for (const auto& [component_id, next] : deleted->add_edges) {
+                erase_edge(next->remove_edges, component_id);
+            }
+            for (const auto& [component_id, previous] : deleted->remove_edges) {
+                erase_edge(previous->add_edges, component_id);
+            }
+        }
 
-            auto new_archetype
-                = std::make_unique<archetype>(key, component_ids);
+        archetype* create_archetype(const archetype_key& key) {
+            // tags are left in the signature only
+            component_id_list component_ids;
+            key.signature.for_each([&](size_t bit) {
+                const auto component_id = static_cast<component_id_t>(bit);
+                if (!component_map_->at(component_id)->is_tag()) {
+                    component_ids.push_back(component_id);
+                }
+            });
 
-            for(size_t i =0; i<component_ids.size(); ++i){
-                new_archetype->component_id_index.emplace(component_ids.at(i),i);
+            // component ids are sorted, the last one sizes the lookup, left
+            // empty past _dense_column_limit where it'd be mostly unused
+            std::vector<uint16_t> column_index;
+            if (!component_ids.empty()
+                && component_ids.back() < _dense_column_limit) {
+                column_index.assign(component_ids.back() + 1, _no_column);
+                for (size_t i = 0; i < component_ids.size(); ++i) {
+                    column_index[component_ids[i]] = static_cast<uint16_t>(i);
+                }
             }
 
+            auto new_archetype = std::make_unique<archetype>(
+                key, component_ids, std::move(column_index),
+                std::pmr::vector<byte_array>(config_.resource),
+                std::pmr::vector<entity_t>(config_.resource));
+
+            size_t row_size = 0;
             for (auto&& componentID : component_ids) {
                 new_archetype->byte_arrays.push_back(
-                    byte_array{new std::byte[0], 0});
+                    byte_array{{}, 0, true, {}, {}});
+                row_size += component_map_->at(componentID)->get_size();
             }
 
-            archetype_keys_.push_back(key);
+            new_archetype->policy = config_.policy;
+            if (config_.policy == storage_policy::chunked) {
+                const size_t rows = std::max<size_t>(
+                    config_.block_size / std::max<size_t>(row_size, 1), 1);
+                new_archetype->block_shift
+                    = std::bit_width(std::bit_floor(rows)) - 1;
+            }
 
-            archetype_hashtable_.emplace(key, std::move(new_archetype));
+            if (free_ids_.empty()) {
+                new_archetype->id = static_cast<archetype_id_t>(slots_.size());
+                slots_.push_back(0);
+            } else {
+                new_archetype->id = free_ids_.back();
+                free_ids_.pop_back();
+            }
+            slots_[new_archetype->id]
+                = static_cast<uint32_t>(archetypes_.size());
+            archetype_hashtable_.emplace(key, new_archetype->id);
+
+            archetype* created = new_archetype.get();
+            keys_.push_back(key);
+            archetypes_.push_back(std::move(new_archetype));
+            for_each_query([&](query_state& query) {
+                if (query.match(key)) {
+                    query.archetypes.push_back(created);
+                }
+            });
+            return created;
+        }
+
+        /**
+         * @brief calls f on every live query, dropping released ones
+         */
+        template <typename F>
+        void for_each_query(F&& f) {
+            std::erase_if(queries_, [&](const std::weak_ptr<query_state>& q) {
+                if (auto query = q.lock()) {
+                    f(*query);
+                    return false;
+                }
+                return true;
+            });
         }
 
        private:
         archetype_handler* archetype_handler_;
+        component_map* component_map_;
+        storage_config config_;
         archetype_hashtable archetype_hashtable_;
-        std::vector<archetype_key> archetype_keys_;
+        // dense arrays, keys_[i] is the key of archetypes_[i]
+        std::vector<std::unique_ptr<archetype>> archetypes_;
+        std::vector<archetype_key> keys_;
+        // position in the dense arrays of each archetype id
+        std::vector<uint32_t> slots_;
+        std::vector<archetype_id_t> free_ids_;
+        std::vector<std::weak_ptr<query_state>> queries_;
     };
 }  // namespace ant
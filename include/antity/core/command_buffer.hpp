@@ -0,0 +1,279 @@
+#pragma once
+#include <antity/core/component.hpp>
+#include <antity/core/identifier.hpp>
+#include <antity/core/soa.hpp>
+#include <antity/core/sparse_set.hpp>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+namespace ant {
+
+    [[nodiscard]] inline constexpr bool is_placeholder(
+        entity_t entity) noexcept {
+        return get_entity_generation(entity) == _placeholder_generation;
+    }
+
+    template <class C>
+    std::unique_ptr<component_base> make_component() {
+        return std::make_unique<Component<C>>();
+    }
+
+    /**
+     * @brief records structural changes to be played back later by
+     *        registry::apply, so that they can be issued while iterating or
+     *        from worker threads. a command_buffer isn't thread safe, use one
+     *        per thread (see concurrent_command_buffer)
+     */
+    class command_buffer {
+       public:
+        command_buffer() = default;
+        command_buffer(const command_buffer&) = delete;
+        command_buffer& operator=(const command_buffer&) = delete;
+
+        ~command_buffer() { clear(); }
+
+        /**
+         * @brief record the creation of an entity
+         * @return placeholder handle, only meaningful to this buffer, that
+         *         commands recorded afterward can target
+         */
+        entity_t create(chunk_id_t chunk_id = _null_chunk) {
+            commands_.push_back(command{command_type::create, chunk_id, 0,
+                                        _null_entity, nullptr});
+            return make_entity(static_cast<index_t>(++create_count_),
+                               _placeholder_generation);
+        }
+
+        void destroy(entity_t entity) {
+            check_target(entity);
+            commands_.push_back(
+                command{command_type::destroy, 0, 0, entity, nullptr});
+        }
+
+        /**
+         * @brief record the addition of a component constructed from args
+         *        right away, adding a component the entity already has
+         *        replaces it. tags record no value, soa components one
+         *        command per field
+         * @throw std::invalid_argument if entity is a placeholder this
+         *        buffer didn't hand out, same for destroy and remove
+         */
+        template <typename C, typename... Args>
+        void add(entity_t entity, Args&&... args) {
+            if constexpr (soa_component<C>) {
+                const C component(std::forward<Args>(args)...);
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    (add<soa_field<C, Is>>(
+                         entity,
+                         soa_field<C, Is>{component.*soa_member<C, Is>}),
+                     ...);
+                }(std::make_index_sequence<soa_field_count<C>>{});
+            } else {
+                check_target(entity);
+                register_component<C>();
+                std::byte* value = nullptr;
+                if constexpr (!is_tag_v<C>) {
+                    value = allocate(sizeof(C), alignof(C));
+                    new (value) C(std::forward<Args>(args)...);
+                }
+                commands_.push_back(command{command_type::add, 0,
+                                            type_id_generator::get<C>(),
+                                            entity, value});
+            }
+        }
+
+        template <typename C>
+        void remove(entity_t entity) {
+            if constexpr (soa_component<C>) {
+                [&]<size_t... Is>(std::index_sequence<Is...>) {
+                    (remove<soa_field<C, Is>>(entity), ...);
+                }(std::make_index_sequence<soa_field_count<C>>{});
+            } else {
+                check_target(entity);
+                register_component<C>();
+                commands_.push_back(command{command_type::remove, 0,
+                                            type_id_generator::get<C>(),
+                                            entity, nullptr});
+            }
+        }
+
+        [[nodiscard]] bool empty() const noexcept { return commands_.empty(); }
+        [[nodiscard]] size_t size() const noexcept { return commands_.size(); }
+
+        /**
+         * @brief drop every command, destroying the values that weren't
+         *        consumed by registry::apply. memory is kept for the next
+         *        commands
+         */
+        void clear() {
+            for (auto& command : commands_) {
+                if (command.value) {
+                    component(command.component_id)
+                        ->destroy_data(command.value);
+                }
+            }
+            commands_.clear();
+            create_count_ = 0;
+            block_ = 0;
+            offset_ = 0;
+        }
+
+       private:
+        friend class registry;
+
+        enum class command_type : uint8_t { create, destroy, add, remove };
+
+        struct command {
+            command_type type;
+            chunk_id_t chunk_id;
+            component_id_t component_id;
+            entity_t entity;
+            // component constructed by add, null once moved out
+            std::byte* value;
+        };
+
+        struct component_entry {
+            std::unique_ptr<component_base> component;
+            std::unique_ptr<component_base> (*make)();
+            const std::type_info* type;
+            // null unless C is a sparse component
+            std::unique_ptr<sparse_set_base> (*make_sparse)();
+        };
+
+        template <typename C>
+        void register_component() {
+            const component_id_t component_id = type_id_generator::get<C>();
+            if (component_id >= components_.size()) {
+                components_.resize(component_id + 1);
+            }
+            auto& entry = components_[component_id];
+            if (!entry.component) {
+                entry = component_entry{make_component<C>(), &make_component<C>,
+                                        &typeid(C), nullptr};
+                if constexpr (sparse_component<C>) {
+                    entry.make_sparse = &make_sparse_set<C>;
+                }
+            }
+        }
+
+        /**
+         * @brief placeholders that don't match a create of this buffer are
+         *        rejected while recording, apply would otherwise fail after
+         *        playing back part of the commands
+         */
+        void check_target(entity_t entity) const {
+            if (is_placeholder(entity)
+                && (get_entity_index(entity) == 0
+                    || get_entity_index(entity) > create_count_)) {
+                throw std::invalid_argument(
+                    "placeholder not created by this command_buffer");
+            }
+        }
+
+        component_base* component(component_id_t component_id) const {
+            return components_[component_id].component.get();
+        }
+
+        /**
+         * @brief bump allocation of the values, blocks are reused after clear
+         */
+        std::byte* allocate(size_t size, size_t alignment) {
+            while (true) {
+                if (block_ < blocks_.size()) {
+                    auto& [data, capacity] = blocks_[block_];
+                    void* ptr = data.get() + offset_;
+                    size_t space = capacity - offset_;
+                    if (std::align(alignment, size, ptr, space)) {
+                        offset_ = capacity - space + size;
+                        return static_cast<std::byte*>(ptr);
+                    }
+                    if (++block_ < blocks_.size()) {
+                        offset_ = 0;
+                        continue;
+                    }
+                }
+                const size_t capacity
+                    = std::max(_block_size, size + alignment);
+                blocks_.emplace_back(std::make_unique<std::byte[]>(capacity),
+                                     capacity);
+                block_ = blocks_.size() - 1;
+                offset_ = 0;
+            }
+        }
+
+        static constexpr size_t _block_size = 64 * 1024;
+
+        std::vector<command> commands_;
+        size_t create_count_ = 0;
+        // indexed by component id, null component if never recorded
+        std::vector<component_entry> components_;
+        std::vector<std::pair<std::unique_ptr<std::byte[]>, size_t>> blocks_;
+        size_t block_ = 0;
+        size_t offset_ = 0;
+    };
+
+    /**
+     * @brief one command_buffer per thread, registry::apply plays them back
+     *        in the order the threads first recorded into them
+     */
+    class concurrent_command_buffer {
+       public:
+        concurrent_command_buffer() : id_(next_id_++) {}
+        concurrent_command_buffer(const concurrent_command_buffer&) = delete;
+        concurrent_command_buffer& operator=(const concurrent_command_buffer&)
+            = delete;
+
+        /**
+         * @brief buffer of the calling thread
+         */
+        command_buffer& local() {
+            thread_local cache_entry cache;
+            if (cache.owner == id_) {
+                return *cache.buffer;
+            }
+            const std::thread::id thread = std::this_thread::get_id();
+            std::lock_guard lock(mutex_);
+            auto it = std::find_if(
+                buffers_.begin(), buffers_.end(),
+                [&](const auto& buffer) { return buffer.first == thread; });
+            if (it == buffers_.end()) {
+                buffers_.emplace_back(thread,
+                                      std::make_unique<command_buffer>());
+                it = std::prev(buffers_.end());
+            }
+            cache = cache_entry{id_, it->second.get()};
+            return *it->second;
+        }
+
+        template <typename F>
+        void for_each_buffer(F&& f) {
+            std::lock_guard lock(mutex_);
+            for (auto& buffer : buffers_) {
+                f(*buffer.second);
+            }
+        }
+
+       private:
+        struct cache_entry {
+            uint64_t owner = 0;
+            command_buffer* buffer = nullptr;
+        };
+
+        // unlike addresses ids are never reused, so a thread cache can't
+        // point into a destroyed instance
+        inline static std::atomic<uint64_t> next_id_{1};
+
+        const uint64_t id_;
+        std::mutex mutex_;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<command_buffer>>>
+            buffers_;
+    };
+
+}  // namespace ant
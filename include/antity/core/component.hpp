@@ -1,14 +1,74 @@
 ﻿#pragma once
 
 #include <antity/core/identifier.hpp>
+#include <antity/core/snapshot.hpp>
 #include <antity/utility/robin_hood.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <new>
+#include <span>
+#include <typeinfo>
 
 namespace ant {
 
+    /**
+     * @brief minimal alignment of every component column, one cache line
+     */
+    inline constexpr size_t _column_alignment = 64;
+
+    /**
+     * @brief data of a span handed out by registry::for_each_span, telling
+     *        the compiler about its alignment
+     */
+    template <typename C>
+    [[nodiscard]] C* aligned_data(std::span<C> span) noexcept {
+        return std::assume_aligned<_column_alignment>(span.data());
+    }
+
+    /**
+     * @brief components that can be moved to another address with a plain
+     *        memcpy, the source being considered destroyed afterward.
+     *        specialize it for types that aren't trivially copyable but
+     *        still relocatable (e.g holding a std::unique_ptr)
+     */
+    template <typename C>
+    struct is_trivially_relocatable
+        : std::bool_constant<std::is_trivially_copyable_v<C>> {};
+
+    template <typename C>
+    inline constexpr bool is_trivially_relocatable_v
+        = is_trivially_relocatable<C>::value;
+
+    /**
+     * @brief empty components are tags, only stored as a bit of the
+     *        archetype signatures: no column, no allocation and nothing to
+     *        move when entities change archetype
+     */
+    template <typename C>
+    inline constexpr bool is_tag_v = std::is_empty_v<C>;
+
+    /**
+     * @brief instance handed out for every entity holding the tag C, an
+     *        empty type has no state to tell them apart
+     */
+    template <typename C>
+    requires(is_tag_v<C>) C& tag_instance() noexcept {
+        static C instance{};
+        return instance;
+    }
+
     class component_base {
        public:
+        component_base(size_t size, bool trivially_relocatable,
+                       bool trivially_copyable, bool tag = false)
+            : size_(size),
+              trivially_relocatable_(trivially_relocatable),
+              trivially_copyable_(trivially_copyable),
+              tag_(tag) {}
+
         virtual ~component_base() {}
 
         virtual void destroy_data(std::byte* data) const = 0;
@@ -16,9 +76,67 @@ namespace ant {
                                std::byte* destination) const = 0;
         virtual void construct_data(std::byte* data) const = 0;
 
-        virtual size_t get_size() const = 0;
-        virtual std::byte* allocate(size_t size) = 0;
+        /**
+         * @brief move construct count contiguous components from source to
+         *        destination, ranges must not overlap
+         */
+        virtual void move_n(std::byte* source, std::byte* destination,
+                            size_t count) const = 0;
+        virtual void destroy_n(std::byte* data, size_t count) const = 0;
+
+        /**
+         * @brief move count components to destination and destroy the
+         *        sources, a single memcpy for trivially relocatable types
+         */
+        void relocate_n(std::byte* source, std::byte* destination,
+                        size_t count) const {
+            if (trivially_relocatable_) {
+                std::memcpy(destination, source, count * size_);
+                return;
+            }
+            move_n(source, destination, count);
+            destroy_n(source, count);
+        }
+
+        size_t get_size() const { return size_; }
+        bool is_trivially_relocatable() const { return trivially_relocatable_; }
+        bool is_trivially_copyable() const { return trivially_copyable_; }
+        /**
+         * @brief see is_tag_v, archetypes have no column for tags
+         */
+        bool is_tag() const { return tag_; }
+        virtual size_t get_alignment() const = 0;
+        virtual std::byte* allocate(std::pmr::memory_resource* resource,
+                                    size_t size) = 0;
+        virtual void deallocate(std::pmr::memory_resource* resource,
+                                std::byte* data, size_t size) = 0;
         virtual component_id_t get() = 0;
+
+        /**
+         * @brief name identifying the component type across runs in
+         *        snapshots, typeid(C).name()
+         */
+        virtual const char* name() const = 0;
+
+        /**
+         * @brief write count contiguous components to out
+         * @throw std::runtime_error if the component isn't serializable
+         */
+        virtual void serialize(std::ostream& out, const std::byte* data,
+                               size_t count) const = 0;
+
+        /**
+         * @brief construct count contiguous components read from in
+         * @throw std::runtime_error if the component isn't serializable
+         */
+        virtual void deserialize(std::istream& in, std::byte* data,
+                                 size_t count) const = 0;
+
+       private:
+        const size_t size_;
+        const bool trivially_relocatable_;
+        const bool trivially_copyable_;
+        const bool tag_;
     };
 
     using component_map
@@ -32,12 +150,27 @@ namespace ant {
             alignas(C) std::byte* data[sizeof(C)];
         };
 
+        Component()
+            : component_base(sizeof(C), is_trivially_relocatable_v<C>,
+                             std::is_trivially_copyable_v<C>, is_tag_v<C>) {}
+
         void destroy_data(std::byte* data) const override;
         void move_data(std::byte* src, std::byte* dst) const override;
         void construct_data(std::byte* data) const override;
-        size_t get_size() const override;
+        void move_n(std::byte* source, std::byte* destination,
+                    size_t count) const override;
+        void destroy_n(std::byte* data, size_t count) const override;
+        size_t get_alignment() const override;
         component_id_t get() override;
-        std::byte* allocate(size_t size) override;
+        std::byte* allocate(std::pmr::memory_resource* resource,
+                            size_t size) override;
+        void deallocate(std::pmr::memory_resource* resource, std::byte* data,
+                        size_t size) override;
+        const char* name() const override;
+        void serialize(std::ostream& out, const std::byte* data,
+                       size_t count) const override;
+        void deserialize(std::istream& in, std::byte* data,
+                         size_t count) const override;
     };
 
     template <class C>
@@ -59,8 +192,23 @@ namespace ant {
     }
 
     template <class C>
-    std::size_t Component<C>::get_size() const {
-        return sizeof(C);
+    void Component<C>::move_n(std::byte* source, std::byte* destination,
+                              size_t count) const {
+        C* first = std::launder(reinterpret_cast<C*>(source));
+        std::uninitialized_move_n(first, count,
+                                  reinterpret_cast<C*>(destination));
+    }
+
+    template <class C>
+    void Component<C>::destroy_n(std::byte* data, size_t count) const {
+        if constexpr (!std::is_trivially_destructible_v<C>) {
+            std::destroy_n(std::launder(reinterpret_cast<C*>(data)), count);
+        }
+    }
+
+    template <class C>
+    std::size_t Component<C>::get_alignment() const {
+        return std::max(alignof(C), _column_alignment);
     }
 
     template <class C>
@@ -69,8 +217,48 @@ namespace ant {
     }
 
     template <class C>
-    std::byte* Component<C>::allocate(size_t size) {
-        alignas(C) std::byte* componentData = new std::byte[size];
-        return componentData;
+    std::byte* Component<C>::allocate(std::pmr::memory_resource* resource,
+                                      size_t size) {
+        return static_cast<std::byte*>(
+            resource->allocate(size, get_alignment()));
+    }
+
+    template <class C>
+    void Component<C>::deallocate(std::pmr::memory_resource* resource,
+                                  std::byte* data, size_t size) {
+        resource->deallocate(data, size, get_alignment());
+    }
+
+    template <class C>
+    const char* Component<C>::name() const {
+        return typeid(C).name();
+    }
+
+    template <class C>
+    void Component<C>::serialize(std::ostream& out, const std::byte* data,
+                                 size_t count) const {
+        if constexpr (custom_serializable<C>) {
+            component_serializer<C>::write(
+                out, std::launder(reinterpret_cast<const C*>(data)), count);
+        } else if constexpr (std::is_trivially_copyable_v<C>) {
+            binary::write_bytes(out, data, count * sizeof(C));
+        } else {
+            throw std::runtime_error(std::string("no component_serializer for ")
+                                     + name());
+        }
+    }
+
+    template <class C>
+    void Component<C>::deserialize(std::istream& in, std::byte* data,
+                                   size_t count) const {
+        if constexpr (custom_serializable<C>) {
+            component_serializer<C>::read(in, reinterpret_cast<C*>(data),
+                                          count);
+        } else if constexpr (std::is_trivially_copyable_v<C>) {
+            binary::read_bytes(in, data, count * sizeof(C));
+        } else {
+            throw std::runtime_error(std::string("no component_serializer for ")
+                                     + name());
+        }
     }
 }  // namespace ant
\ No newline at end of file
@@ -1,4 +1,7 @@
+#pragma once
 #include <antity/core/archetype.hpp>
+#include <antity/core/filter.hpp>
+#include <new>
 
 namespace ant {
 
@@ -88,26 +91,66 @@ namespace ant {
 
         component_array() = default;
 
-        component_array(byte_array* byteArray)
-            : data(reinterpret_cast<C*>(byteArray->componentData)),
-              byteArray(byteArray) {}
+        component_array(byte_array* byteArray, archetype* arch)
+            : byteArray(byteArray), arch(arch) {}
 
         const C& operator[](size_t index) const {
-            return data[index];
+            return block(index >> arch->block_shift)
+                [index & (arch->block_capacity() - 1)];
         }
 
-        C& operator[](size_t index) { return data[index]; }
-
-        bool valid() const noexcept { return data != nullptr; }
+        C& operator[](size_t index) {
+            return block(index >> arch->block_shift)
+                [index & (arch->block_capacity() - 1)];
+        }
 
-        C* begin() { return data; }
+        /**
+         * @brief first component of the given block, components of the block
+         *        are contiguous up to archetype::block_end
+         */
+        C* block(size_t block) const {
+            return std::launder(
+                reinterpret_cast<C*>(byteArray->blocks[block]));
+        }
 
-        C* end() { return data + byteArray->size; }
+        bool valid() const noexcept { return byteArray != nullptr; }
 
-        int16_t size() { return byteArray->size; }
+        size_t size() const { return arch->entities.size(); }
 
-        C* data{nullptr};
         byte_array* byteArray{nullptr};
+        archetype* arch{nullptr};
+    };
+
+    /**
+     * @brief tags have no column, the single block of every archetype
+     *        holding the tag is its tag_instance
+     */
+    template <typename C>
+    requires(is_tag_v<C> && !is_optional_v<C>) struct component_array<C> {
+        component_array() = default;
+
+        explicit component_array(bool present) : present(present) {}
+
+        C* block(size_t) const {
+            return present ? &tag_instance<std::remove_cv_t<C>>() : nullptr;
+        }
+
+        bool valid() const noexcept { return present; }
+
+        bool present = false;
+    };
+
+    /**
+     * @brief column of an optional component, invalid when the archetype
+     *        lacks it, blocks are then null
+     */
+    template <typename C>
+    struct component_array<optional_t<C>> : component_array<C> {
+        using component_array<C>::component_array;
+
+        C* block(size_t block) const {
+            return this->valid() ? component_array<C>::block(block) : nullptr;
+        }
     };
 
     template <typename C>
@@ -117,9 +160,32 @@ namespace ant {
 
     template <typename C>
     inline auto get_component_array(archetype* arch) {
-        return (component_array<std::remove_reference_t<C>>(
-            &arch->byte_arrays[arch->component_id_index.at(
-                type_id_generator::get<C>())]));
+        using component = std::remove_reference_t<C>;
+        static_assert(!soa_component<component>,
+                      "soa components are only handed out by for_each and "
+                      "for_each_span");
+        if constexpr (is_tag_v<component>) {
+            // views only visit archetypes holding the required tags
+            return component_array<component>(true);
+        } else {
+            return (component_array<component>(
+                &arch->byte_arrays[arch->column(type_id_generator::get<C>())],
+                arch));
+        }
+    }
+
+    template <typename C>
+    requires(is_optional_v<C>) inline auto get_component_array(
+        archetype* arch) {
+        const component_id_t id = type_id_generator::get<typename C::type>();
+        if constexpr (is_tag_v<typename C::type>) {
+            return component_array<C>(arch->key.signature.test(id));
+        } else {
+            const size_t column = arch->find_column(id);
+            return component_array<C>(
+                column == _no_column ? nullptr : &arch->byte_arrays[column],
+                arch);
+        }
     }
 
 }  // namespace ant
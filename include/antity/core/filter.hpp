@@ -0,0 +1,185 @@
+#pragma once
+#include <antity/core/archetype.hpp>
+#include <antity/core/identifier.hpp>
+#include <concepts>
+#include <cstdint>
+#include <vector>
+
+namespace ant {
+
+    /**
+     * @brief archetype level conditions of a view or a for_each, built once
+     *        from its filters and tested with a few signature operations
+     *        per archetype
+     */
+    struct query_mask {
+        // components every archetype must have
+        signature_t include{};
+        // components no archetype may have
+        signature_t exclude{};
+        // archetypes must have at least a component of each
+        std::vector<signature_t> any_of{};
+
+        /**
+         * @brief exclude and any_of conditions, include is matched through
+         *        the archetype_map
+         */
+        [[nodiscard]] bool accepts(const signature_t& signature) const {
+            if (signature.intersects(exclude)) {
+                return false;
+            }
+            for (const signature_t& any : any_of) {
+                if (!signature.intersects(any)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    /**
+     * @brief filter of views and for_each, restrict adds its archetype
+     *        level conditions to the mask
+     */
+    template <typename F>
+    concept query_filter = requires(const F& filter, query_mask& mask) {
+        filter.restrict(mask);
+    };
+
+    /**
+     * @brief filter of for_each that is also evaluated block by block
+     */
+    template <typename F>
+    concept block_filter = query_filter<F> && requires(const F& filter,
+                                                       const archetype& arch,
+                                                       size_t block) {
+        { filter.accepts(arch, block) } -> std::convertible_to<bool>;
+    };
+
+    template <typename... Cs>
+    struct exclude_t {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components can't be filtered on");
+
+        void restrict(query_mask& mask) const {
+            mask.exclude |= get_signature<Cs...>();
+        }
+    };
+
+    template <typename... Cs>
+    struct any_of_t {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components can't be filtered on");
+
+        void restrict(query_mask& mask) const {
+            mask.any_of.push_back(get_signature<Cs...>());
+        }
+    };
+
+    /**
+     * @brief component the archetypes may lack, views hand it out as a C*
+     *        that is null for every entity of such an archetype. for_each
+     *        takes C* parameters for that
+     */
+    template <typename C>
+    struct optional_t {
+        static_assert(!sparse_component<C>,
+                      "sparse components are only handed out by for_each "
+                      "and get_entity_components");
+
+        using type = C;
+
+        void restrict(query_mask&) const {}
+    };
+
+    template <typename C>
+    inline constexpr bool is_optional_v = false;
+
+    template <typename C>
+    inline constexpr bool is_optional_v<optional_t<C>> = true;
+
+    /**
+     * @brief skip the archetypes holding any of Cs
+     */
+    template <typename... Cs>
+    inline constexpr exclude_t<Cs...> exclude{};
+
+    /**
+     * @brief skip the archetypes holding none of Cs
+     */
+    template <typename... Cs>
+    inline constexpr any_of_t<Cs...> any_of{};
+
+    template <typename C>
+    inline constexpr optional_t<C> optional{};
+
+    namespace details {
+        [[nodiscard]] inline bool since(const std::vector<uint64_t>& epochs,
+                                        size_t block, uint64_t epoch) noexcept {
+            return block < epochs.size() && epochs[block] >= epoch;
+        }
+
+        /**
+         * @brief whether a column of C, any field of a soa component, has
+         *        its epochs of the block at or after epoch
+         */
+        template <typename C>
+        [[nodiscard]] bool since(const archetype& arch,
+                                 std::vector<uint64_t> byte_array::*epochs,
+                                 size_t block, uint64_t epoch) noexcept {
+            for (component_id_t component_id : column_ids<C>()) {
+                const size_t column = arch.find_column(component_id);
+                if (column != _no_column
+                    && since(arch.byte_arrays[column].*epochs, block,
+                             epoch)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }  // namespace details
+
+    /**
+     * @brief keeps the blocks in which a C was handed out for writing or
+     *        added at or after epoch since, see registry::checkpoint. a
+     *        block handed out counts as changed even if it wasn't written
+     */
+    template <typename C>
+    struct changed {
+        static_assert(!sparse_component<C>,
+                      "sparse components can't be filtered on");
+
+        uint64_t since;
+
+        void restrict(query_mask& mask) const {
+            mask.include |= get_signature<C>();
+        }
+
+        [[nodiscard]] bool accepts(const archetype& arch,
+                                   size_t block) const noexcept {
+            return details::since<C>(arch, &byte_array::written, block, since);
+        }
+    };
+
+    /**
+     * @brief keeps the blocks in which a C was added to an entity at or
+     *        after epoch since, by create, add or a restore
+     */
+    template <typename C>
+    struct added {
+        static_assert(!sparse_component<C>,
+                      "sparse components can't be filtered on");
+
+        uint64_t since;
+
+        void restrict(query_mask& mask) const {
+            mask.include |= get_signature<C>();
+        }
+
+        [[nodiscard]] bool accepts(const archetype& arch,
+                                   size_t block) const noexcept {
+            return details::since<C>(arch, &byte_array::added, block, since);
+        }
+    };
+
+}  // namespace ant
@@ -1,5 +1,5 @@
 #pragma once
-#include <bitset>
+#include <antity/core/signature.hpp>
 #include <cstdint>
 #include <vector>
 
@@ -8,13 +8,47 @@ namespace ant {
     using id_t = uint32_t;
     using component_id_t = id_t;
     using index_t = id_t;
-    using entity_t = id_t;
+    using generation_t = id_t;
+    /**
+     * @brief entity handle, low bits are the index of the entity record and
+     *        high bits the generation of that record when the handle was
+     *        given, so a recycled index never aliases a stale handle
+     */
+    using entity_t = uint64_t;
     using chunk_id_t = id_t;
-    inline constexpr id_t _null_entity = 0;
+    using archetype_id_t = id_t;
+    inline constexpr entity_t _null_entity = 0;
     inline constexpr id_t _null_chunk = UINT32_MAX;
-    inline constexpr uint16_t _max_components = 64;
-    using signature_t = std::bitset<_max_components>;
+    /**
+     * @brief generation of the placeholder handles given by
+     *        command_buffer::create, never used by live entities
+     */
+    inline constexpr generation_t _placeholder_generation = UINT32_MAX;
+    inline constexpr uint16_t _entity_index_bits = 32;
+    /**
+     * @brief components a signature holds without allocating, there is no
+     *        upper limit
+     */
+    inline constexpr size_t _inline_components
+        = signature::_inline_words * signature::_word_bits;
+    using signature_t = signature;
     using component_id_list = std::vector<component_id_t>;
+
+    [[nodiscard]] inline constexpr entity_t make_entity(
+        index_t index, generation_t generation) noexcept {
+        return (static_cast<entity_t>(generation) << _entity_index_bits)
+               | index;
+    }
+
+    [[nodiscard]] inline constexpr index_t get_entity_index(
+        entity_t entity) noexcept {
+        return static_cast<index_t>(entity);
+    }
+
+    [[nodiscard]] inline constexpr generation_t get_entity_generation(
+        entity_t entity) noexcept {
+        return static_cast<generation_t>(entity >> _entity_index_bits);
+    }
     class type_id_generator {
         inline static id_t identifier() noexcept {
             static id_t value = 0;
@@ -35,42 +69,41 @@ namespace ant {
         }
     };
 
-    inline static signature_t get_type_signature(id_t id) noexcept {
-        return signature_t(1ULL << static_cast<uint64_t>(id));
+    inline static signature_t get_type_signature(id_t id) {
+        return signature_t{}.set(id);
     }
 
     template <typename T>
-    inline static signature_t get_type_signature() noexcept {
+    inline static signature_t get_type_signature() {
         return get_type_signature(type_id_generator::get<T>());
     }
 
     template <typename T>
     inline static signature_t add_type_to_signature(
         const signature_t& signature) {
-        return signature | get_type_signature<T>();
+        return signature_t{signature}.set(type_id_generator::get<T>());
     }
 
     template <typename T>
     inline static signature_t remove_type_to_signature(
         const signature_t& signature) {
-        return signature & (~get_type_signature<T>());
+        return signature_t{signature}.reset(type_id_generator::get<T>());
     }
 
     inline auto type_ids_to_signature(const component_id_list& type_ids) {
         signature_t signature;
         for (auto componentId : type_ids) {
-            signature |= get_type_signature(componentId);
+            signature.set(componentId);
         }
         return signature;
     }
 
-    inline auto signature_to_type_ids(const signature_t signature) {
+    inline auto signature_to_type_ids(const signature_t& signature) {
         component_id_list id;
-        for (size_t i = 0; i < signature.size(); ++i) {
-            if (signature[i]) {
-                id.push_back(i);
-            }
-        }
+        id.reserve(signature.count());
+        signature.for_each([&](size_t bit) {
+            id.push_back(static_cast<component_id_t>(bit));
+        });
         return id;
     }
 }  // namespace ant
@@ -0,0 +1,218 @@
+#pragma once
+#include <antity/core/archetype.hpp>
+#include <antity/core/identifier.hpp>
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace ant {
+
+    using observer_id = uint32_t;
+
+    enum class observer_event : uint8_t { add, remove, destroy };
+
+    /**
+     * @brief observer called once per entity, as the event happens
+     */
+    template <typename F>
+    concept immediate_observer = std::invocable<F&, entity_t>;
+
+    /**
+     * @brief observer called with the entities of its events grouped per
+     *        archetype, on registry::flush_observers
+     */
+    template <typename F>
+    concept batched_observer = std::invocable<F&, std::span<const entity_t>>;
+
+    /**
+     * @brief observers of the registry by event and component, add and
+     *        remove events are keyed by the first column id of their
+     *        component so that a soa component is observed through its
+     *        first field
+     */
+    class observer_map {
+       public:
+        /**
+         * @param component_id ignored for destroy events
+         */
+        template <typename F>
+        requires(immediate_observer<F> || batched_observer<F>) observer_id
+            connect(observer_event event, component_id_t component_id,
+                    F&& f) {
+            check_delivery();
+            observer added{next_id_++, event, component_id,
+                           batched_observer<F>};
+            if constexpr (batched_observer<F>) {
+                added.callback = std::forward<F>(f);
+            } else {
+                added.callback
+                    = [f = std::forward<F>(f)](
+                          std::span<const entity_t> entities) mutable {
+                          for (entity_t entity : entities) {
+                              f(entity);
+                          }
+                      };
+            }
+            observers_.push_back(std::move(added));
+            refresh();
+            return observers_.back().id;
+        }
+
+        /**
+         * @brief drops the observer and its pending batches, unknown ids
+         *        are ignored
+         */
+        void disconnect(observer_id id) {
+            check_delivery();
+            std::erase_if(observers_,
+                          [&](const observer& o) { return o.id == id; });
+            refresh();
+        }
+
+        /**
+         * @brief whether an event on component_id has observers, checked
+         *        before collecting the entities of a notification
+         */
+        [[nodiscard]] bool observed(observer_event event,
+                                    component_id_t component_id) const {
+            switch (event) {
+                case observer_event::add:
+                    return added_.test(component_id);
+                case observer_event::remove:
+                    return removed_.test(component_id);
+                default:
+                    return destroyed_;
+            }
+        }
+
+        /**
+         * @brief components whose add or remove events have observers
+         */
+        [[nodiscard]] const signature_t& observed(observer_event event) const {
+            return event == observer_event::add ? added_ : removed_;
+        }
+
+        /**
+         * @brief calls the immediate observers of the event and queues the
+         *        entities for the batched ones
+         * \param arch archetype the entities entered for an add, left for
+         * a remove or a destroy, null if they have no component
+         */
+        void notify(observer_event event, component_id_t component_id,
+                    const archetype* arch, std::span<const entity_t> entities) {
+            if (entities.empty()) {
+                return;
+            }
+            const archetype_id_t group = arch ? arch->id : _no_archetype;
+            delivering_++;
+            try {
+                for (observer& o : observers_) {
+                    if (o.event != event
+                        || (event != observer_event::destroy
+                            && o.component_id != component_id)) {
+                        continue;
+                    }
+                    if (o.batched) {
+                        o.queue(group, entities);
+                    } else {
+                        o.callback(entities);
+                    }
+                }
+            } catch (...) {
+                delivering_--;
+                throw;
+            }
+            delivering_--;
+        }
+
+        /**
+         * @brief hands the queued entities to the batched observers, in the
+         *        order the observers were connected then per archetype, in
+         *        the order the archetypes first appeared. the events raised
+         *        meanwhile are delivered on the next flush
+         */
+        void flush() {
+            check_delivery();
+            delivering_++;
+            try {
+                for (observer& o : observers_) {
+                    for (const batch& b : std::exchange(o.batches, {})) {
+                        o.callback(b.entities);
+                    }
+                }
+            } catch (...) {
+                delivering_--;
+                throw;
+            }
+            delivering_--;
+        }
+
+       private:
+        static constexpr archetype_id_t _no_archetype = UINT32_MAX;
+
+        struct batch {
+            archetype_id_t arch{_no_archetype};
+            std::vector<entity_t> entities{};
+        };
+
+        struct observer {
+            observer_id id{};
+            observer_event event{};
+            component_id_t component_id{};
+            bool batched = false;
+            std::function<void(std::span<const entity_t>)> callback{};
+            std::vector<batch> batches{};
+
+            void queue(archetype_id_t arch,
+                       std::span<const entity_t> entities) {
+                // mostly the last archetype again
+                auto it = std::find_if(
+                    batches.rbegin(), batches.rend(),
+                    [&](const batch& b) { return b.arch == arch; });
+                std::vector<entity_t>& queued
+                    = it != batches.rend()
+                          ? it->entities
+                          : batches.emplace_back(batch{arch}).entities;
+                queued.insert(queued.end(), entities.begin(), entities.end());
+            }
+        };
+
+        void check_delivery() const {
+            if (delivering_ > 0) {
+                throw std::logic_error(
+                    "observers changed or flushed from an observer");
+            }
+        }
+
+        void refresh() {
+            added_ = {};
+            removed_ = {};
+            destroyed_ = false;
+            for (const observer& o : observers_) {
+                switch (o.event) {
+                    case observer_event::add:
+                        added_.set(o.component_id);
+                        break;
+                    case observer_event::remove:
+                        removed_.set(o.component_id);
+                        break;
+                    default:
+                        destroyed_ = true;
+                }
+            }
+        }
+
+        std::vector<observer> observers_;
+        signature_t added_;
+        signature_t removed_;
+        bool destroyed_ = false;
+        observer_id next_id_ = 0;
+        uint32_t delivering_ = 0;
+    };
+
+}  // namespace ant
@@ -0,0 +1,141 @@
+#pragma once
+#include <antity/core/archetype.hpp>
+#include <antity/core/archetype_handler.hpp>
+#include <antity/core/filter.hpp>
+#include <antity/core/view.hpp>
+#include <memory>
+
+namespace ant {
+
+    /**
+     * @brief persistent query over the archetypes holding Cs, the list of
+     *        matching archetypes is updated by the archetype_map when
+     *        archetypes are created or deleted so iterating never tests
+     *        archetypes that don't match
+     *
+     * @tparam Cs components to be retrieved
+     */
+    template <typename... Cs>
+    class query {
+       public:
+        using archetype_iterator =
+            typename archetype_view<Cs...>::archetype_view_iterator;
+
+        class query_iterator {
+           public:
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = typename archetype_iterator::value_type;
+            using pointer = typename archetype_iterator::pointer;
+            using reference = typename archetype_iterator::reference;
+
+            query_iterator(size_t archetype_index, query_state* state)
+                : archetype_index_(archetype_index), state_(state) {
+                seek_archetype();
+            }
+
+            query_iterator& operator++() noexcept {
+                if (++archetype_view_iterator_ == archetype_view_end_) {
+                    ++archetype_index_;
+                    seek_archetype();
+                }
+                return *this;
+            }
+
+            query_iterator operator++(int) noexcept {
+                query_iterator tmp = *this;
+                return ++(*this), tmp;
+            }
+
+            [[nodiscard]] bool operator==(
+                const query_iterator& other) const noexcept {
+                return other.archetype_index_ == archetype_index_;
+            }
+
+            [[nodiscard]] bool operator!=(
+                const query_iterator& other) const noexcept {
+                return !(*this == other);
+            }
+
+            [[nodiscard]] pointer operator->() const {
+                return archetype_view_iterator_.operator->();
+            }
+
+            [[nodiscard]] reference operator*() const {
+                return *archetype_view_iterator_;
+            }
+
+           private:
+            void seek_archetype() {
+                for (; archetype_index_ < state_->archetypes.size();
+                     ++archetype_index_) {
+                    archetype* arch = state_->archetypes[archetype_index_];
+                    if (arch->entities.empty()) {
+                        continue;
+                    }
+                    current_view_ = archetype_view<Cs...>(arch);
+                    archetype_view_iterator_ = current_view_.begin();
+                    archetype_view_end_ = current_view_.end();
+                    return;
+                }
+            }
+
+            size_t archetype_index_;
+            query_state* state_;
+            archetype_view<Cs...> current_view_;
+            archetype_iterator archetype_view_iterator_;
+            archetype_iterator archetype_view_end_;
+        };
+
+        query(std::shared_ptr<query_state> state, archetype_handler* handler)
+            : state_(std::move(state)), archetype_handler_(handler) {}
+
+        /**
+         * @brief calls f(entity_t, Cs&...) on every matching entity
+         */
+        template <typename F>
+        void for_each(F&& f) {
+            type_list<entity_t, Cs&...> types;
+            for (archetype* arch : state_->archetypes) {
+                archetype_handler_->apply(std::forward<F>(f), types, arch);
+            }
+        }
+
+        /**
+         * @brief for_each restricted to the blocks every filter accepts,
+         *        archetypes missing a filter component are skipped
+         */
+        template <typename F, block_filter... Filters>
+        requires(sizeof...(Filters) > 0) void for_each(
+            F&& f, const Filters&... filters) {
+            type_list<entity_t, Cs&...> types;
+            for (archetype* arch : state_->archetypes) {
+                archetype_handler_->apply_filtered(f, types, arch, filters...);
+            }
+        }
+
+        query_iterator begin() {
+            for (archetype* arch : state_->archetypes) {
+                archetype_handler_->mark_written<Cs&...>(
+                    arch, 0, arch->entities.size());
+            }
+            return query_iterator{0, state_.get()};
+        }
+
+        query_iterator end() {
+            return query_iterator{state_->archetypes.size(), state_.get()};
+        }
+
+        /**
+         * @brief matching archetypes, including empty ones
+         */
+        const std::vector<archetype*>& archetypes() const {
+            return state_->archetypes;
+        }
+
+       private:
+        std::shared_ptr<query_state> state_;
+        archetype_handler* archetype_handler_;
+    };
+
+}  // namespace ant
@@ -1,16 +1,352 @@
 #pragma once
 #include <antity/core/archetype.hpp>
 #include <antity/core/identifier.hpp>
-#include <antity/utility/robin_hood.hpp>
+#include <antity/core/snapshot.hpp>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
 
 namespace ant {
 
     struct record_t {
         archetype* entity_archetype = nullptr;
+        // row in entity_archetype, next free record while the record is free
         index_t index = 0;
         chunk_id_t chunk_id = 0;
+        generation_t generation = 0;
     };
 
-    using entity_index = robin_hood::unordered_map<entity_t, record_t>;
+    /**
+     * @brief dense entity records indexed by the index part of the handles,
+     *        free records are chained through record_t::index
+     */
+    class entity_index {
+       public:
+        /**
+         * @brief record 0 is reserved so that _null_entity is never valid
+         */
+        entity_index() : records_(1) {}
 
-}  // namespace ant
\ No newline at end of file
+        entity_t create(chunk_id_t chunk_id) {
+            if (free_head_ != _no_free_record) {
+                const index_t index = free_head_;
+                record_t& record = records_[index];
+                free_head_ = record.index;
+                record.entity_archetype = nullptr;
+                record.index = 0;
+                record.chunk_id = chunk_id;
+                alive_++;
+                touch_index(index);
+                return make_entity(index, record.generation);
+            }
+            records_.push_back(record_t{nullptr, 0, chunk_id, 0});
+            alive_++;
+            touch_index(records_.size() - 1);
+            return make_entity(static_cast<index_t>(records_.size() - 1), 0);
+        }
+
+        /**
+         * @brief create count entities whose record are copies of first,
+         *        record::index being incremented from one entity to the next
+         */
+        template <std::output_iterator<entity_t> OutputIt>
+        OutputIt create_n(size_t count, record_t first, OutputIt out) {
+            for (; count > 0 && free_head_ != _no_free_record; --count) {
+                const index_t index = free_head_;
+                record_t& record = records_[index];
+                free_head_ = record.index;
+                *out++ = make_entity(index, record.generation);
+                record = record_t{first.entity_archetype, first.index++,
+                                  first.chunk_id, record.generation};
+                alive_++;
+                touch_index(index);
+            }
+            index_t index = static_cast<index_t>(records_.size());
+            touch_range(index, index + count);
+            records_.resize(records_.size() + count);
+            for (; count > 0; --count, ++index) {
+                *out++ = make_entity(index, 0);
+                records_[index] = record_t{first.entity_archetype,
+                                           first.index++, first.chunk_id, 0};
+                alive_++;
+            }
+            return out;
+        }
+
+        /**
+         * @brief invalidates every handle to the entity and recycles its
+         *        record
+         */
+        void destroy(entity_t entity) {
+            record_t& record = at(entity);
+            record.entity_archetype = nullptr;
+            // the last generation is left to placeholder handles
+            if (++record.generation == _placeholder_generation) {
+                record.generation = 0;
+            }
+            record.index = free_head_;
+            free_head_ = get_entity_index(entity);
+            alive_--;
+            touch_index(free_head_);
+        }
+
+        /**
+         * @brief flag the record of the entity as changed at the current
+         *        epoch, for the changes made to it outside of entity_index
+         *        that deltas have to carry (chunk id)
+         */
+        void touch(entity_t entity) { touch_index(get_entity_index(entity)); }
+
+        /**
+         * @brief changes are tagged with the current epoch, see
+         *        registry::checkpoint
+         */
+        [[nodiscard]] uint64_t epoch() const noexcept { return epoch_; }
+
+        /**
+         * @return the new epoch
+         */
+        uint64_t advance_epoch() noexcept { return ++epoch_; }
+
+        /**
+         * @brief drop every record, the epoch is kept so that the change
+         *        shows in the next deltas
+         */
+        void clear() {
+            records_.assign(1, record_t{});
+            free_head_ = _no_free_record;
+            alive_ = 0;
+            written_.clear();
+        }
+
+        [[nodiscard]] bool contains(entity_t entity) const noexcept {
+            const index_t index = get_entity_index(entity);
+            // destroy bumps the generation of the record past every handle
+            // given for it
+            return index != 0 && index < records_.size()
+                   && records_[index].generation
+                          == get_entity_generation(entity);
+        }
+
+        record_t& at(entity_t entity) {
+            if (!contains(entity)) {
+                throw std::out_of_range("invalid entity_t");
+            }
+            return records_[get_entity_index(entity)];
+        }
+
+        /**
+         * @brief unchecked access, entity has to be valid
+         */
+        record_t& operator[](entity_t entity) noexcept {
+            return records_[get_entity_index(entity)];
+        }
+
+        void reserve(size_t count) { records_.reserve(count + 1); }
+
+        /**
+         * @brief live entities of the chunk that no archetype stores, those
+         *        without components. scans every record
+         */
+        [[nodiscard]] std::vector<entity_t> unstored_entities(
+            chunk_id_t chunk_id) const {
+            std::vector<bool> free(records_.size());
+            for (index_t index = free_head_; index != _no_free_record;
+                 index = records_[index].index) {
+                free[index] = true;
+            }
+            std::vector<entity_t> entities;
+            for (size_t index = 1; index < records_.size(); index++) {
+                const record_t& record = records_[index];
+                if (!free[index] && record.entity_archetype == nullptr
+                    && record.chunk_id == chunk_id) {
+                    entities.push_back(make_entity(
+                        static_cast<index_t>(index), record.generation));
+                }
+            }
+            return entities;
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return alive_; }
+
+        /**
+         * @brief number of records, free ones included, every entity index
+         *        is below it
+         */
+        [[nodiscard]] size_t extent() const noexcept { return records_.size(); }
+
+        /**
+         * @brief write the records, free list included, archetypes aren't
+         *        written and are bound back by registry::restore
+         */
+        void snapshot(std::ostream& out) const {
+            binary::write(out, static_cast<uint64_t>(records_.size()));
+            binary::write(out, free_head_);
+            binary::write(out, static_cast<uint64_t>(alive_));
+            // packed by batches, one stream write each
+            std::vector<packed_record> batch;
+            batch.reserve(_snapshot_batch);
+            for (size_t first = 0; first < records_.size();
+                 first += _snapshot_batch) {
+                const size_t last
+                    = std::min(first + _snapshot_batch, records_.size());
+                batch.clear();
+                for (size_t i = first; i < last; i++) {
+                    const record_t& record = records_[i];
+                    batch.push_back(packed_record{record.index, record.chunk_id,
+                                                  record.generation});
+                }
+                binary::write_bytes(out, batch.data(),
+                                    batch.size() * sizeof(packed_record));
+            }
+        }
+
+        /**
+         * @brief replace the records by the ones written by snapshot, every
+         *        record is left without archetype
+         */
+        void restore(std::istream& in) {
+            std::vector<record_t> records(binary::read<uint64_t>(in));
+            const index_t free_head = binary::read<index_t>(in);
+            const size_t alive = binary::read<uint64_t>(in);
+            std::vector<packed_record> batch;
+            for (size_t first = 0; first < records.size();
+                 first += _snapshot_batch) {
+                batch.resize(
+                    std::min(_snapshot_batch, records.size() - first));
+                binary::read_bytes(in, batch.data(),
+                                   batch.size() * sizeof(packed_record));
+                for (size_t i = 0; i < batch.size(); i++) {
+                    records[first + i] = record_t{nullptr, batch[i].index,
+                                                  batch[i].chunk_id,
+                                                  batch[i].generation};
+                }
+            }
+            if (records.empty() || free_head >= records.size()
+                || alive >= records.size()) {
+                throw std::runtime_error("corrupted snapshot entity index");
+            }
+            records_ = std::move(records);
+            free_head_ = free_head;
+            alive_ = alive;
+            touch_range(0, records_.size());
+        }
+
+        /**
+         * @brief write the count of records, the free list and the batches
+         *        of records holding one changed at or after since
+         */
+        void snapshot_delta(std::ostream& out, uint64_t since) const {
+            binary::write(out, static_cast<uint64_t>(records_.size()));
+            binary::write(out, free_head_);
+            binary::write(out, static_cast<uint64_t>(alive_));
+            const size_t batches
+                = std::min(written_.size(),
+                           (records_.size() + _snapshot_batch - 1)
+                               / _snapshot_batch);
+            binary::write(out,
+                          static_cast<uint64_t>(std::count_if(
+                              written_.begin(), written_.begin() + batches,
+                              [&](uint64_t epoch) { return epoch >= since; })));
+            std::vector<packed_record> batch;
+            batch.reserve(_snapshot_batch);
+            for (size_t b = 0; b < batches; b++) {
+                if (written_[b] < since) {
+                    continue;
+                }
+                const size_t first = b * _snapshot_batch;
+                const size_t last
+                    = std::min(first + _snapshot_batch, records_.size());
+                batch.clear();
+                for (size_t i = first; i < last; i++) {
+                    const record_t& record = records_[i];
+                    batch.push_back(packed_record{record.index, record.chunk_id,
+                                                  record.generation});
+                }
+                binary::write(out, static_cast<uint64_t>(b));
+                binary::write_bytes(out, batch.data(),
+                                    batch.size() * sizeof(packed_record));
+            }
+        }
+
+        /**
+         * @brief apply the output of snapshot_delta. records whose generation
+         *        changes lose their archetype, the others keep it until
+         *        registry::apply_delta binds them again
+         */
+        void apply_delta(std::istream& in) {
+            const size_t extent = binary::read<uint64_t>(in);
+            const index_t free_head = binary::read<index_t>(in);
+            const size_t alive = binary::read<uint64_t>(in);
+            if (extent == 0 || free_head >= extent || alive >= extent) {
+                throw std::runtime_error("corrupted snapshot entity index");
+            }
+            records_.resize(extent);
+            free_head_ = free_head;
+            alive_ = alive;
+            const size_t batches = binary::read<uint64_t>(in);
+            std::vector<packed_record> batch;
+            for (size_t i = 0; i < batches; i++) {
+                const size_t first
+                    = binary::read<uint64_t>(in) * _snapshot_batch;
+                if (first >= extent) {
+                    throw std::runtime_error("corrupted snapshot entity index");
+                }
+                batch.resize(std::min(_snapshot_batch, extent - first));
+                binary::read_bytes(in, batch.data(),
+                                   batch.size() * sizeof(packed_record));
+                for (size_t k = 0; k < batch.size(); k++) {
+                    record_t& record = records_[first + k];
+                    if (record.generation != batch[k].generation) {
+                        record.entity_archetype = nullptr;
+                    }
+                    record.index = batch[k].index;
+                    record.chunk_id = batch[k].chunk_id;
+                    record.generation = batch[k].generation;
+                }
+                touch_range(first, first + batch.size());
+            }
+        }
+
+       private:
+        void touch_index(size_t index) {
+            const size_t batch = index / _snapshot_batch;
+            if (batch >= written_.size()) [[unlikely]] {
+                written_.resize(batch + 1, 0);
+            }
+            written_[batch] = epoch_;
+        }
+
+        void touch_range(size_t first, size_t last) {
+            if (first >= last) {
+                return;
+            }
+            const size_t first_batch = first / _snapshot_batch;
+            const size_t last_batch = (last - 1) / _snapshot_batch;
+            if (written_.size() <= last_batch) {
+                written_.resize(last_batch + 1, 0);
+            }
+            std::fill(written_.begin() + first_batch,
+                      written_.begin() + last_batch + 1, epoch_);
+        }
+
+        static constexpr index_t _no_free_record = 0;
+        static constexpr size_t _snapshot_batch = 4096;
+
+        // record_t without the archetype, as written in snapshots
+        struct packed_record {
+            index_t index;
+            chunk_id_t chunk_id;
+            generation_t generation;
+        };
+
+        std::vector<record_t> records_;
+        index_t free_head_ = _no_free_record;
+        size_t alive_ = 0;
+        uint64_t epoch_ = 1;
+        // epoch each batch of _snapshot_batch records last changed
+        std::vector<uint64_t> written_;
+    };
+
+}  // namespace ant
@@ -1,35 +1,70 @@
 #pragma once
 #include <antity/core/archetype_handler.hpp>
 #include <antity/core/archetype_map.hpp>
+#include <antity/core/command_buffer.hpp>
 #include <antity/core/component.hpp>
+#include <antity/core/filter.hpp>
+#include <antity/core/observer.hpp>
 #include <antity/core/identifier.hpp>
+#include <antity/core/query.hpp>
 #include <antity/core/record.hpp>
 #include <antity/core/registry_debugger.hpp>
 #include <antity/core/view.hpp>
 #include <antity/utility/function_traits.hpp>
-#include <antity/utility/unique_id_dispenser.hpp>
+#include <antity/utility/mapped_file.hpp>
+#include <antity/utility/thread_pool.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <concepts>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <istream>
+#include <map>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <ranges>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace ant {
 
+    /**
+     * @brief rows per par_for_each task in contiguous archetypes
+     */
+    inline constexpr size_t _parallel_grain = 16 * 1024;
+
+    class scheduler;
+
     class registry {
        public:
         using entity_type = entity_t;
 
-        registry()
+        /**
+         * @param config storage layout of the archetypes columns, chunked
+         * storage never relocates live components when an archetype grows.
+         * columns are allocated from config.resource aligned on
+         * max(alignof(C), _column_alignment)
+         */
+        registry(storage_config config = {})
             : entity_index_(std::make_unique<entity_index>()),
               component_map_(std::make_unique<component_map>()),
-              archetype_handler_(
-                  archetype_handler{entity_index_.get(), component_map_.get()}),
-              archetype_map_(&archetype_handler_) {}
+              archetype_handler_(archetype_handler{
+                  entity_index_.get(), component_map_.get(), config.resource}),
+              archetype_map_(&archetype_handler_, component_map_.get(),
+                             config) {}
 
         ~registry() {
-            for (auto&& it : *archetype_map_.get()) {
+            for (size_t i = 0; i < archetype_map_.size(); ++i) {
                 archetype_handler_.clean_archetype_component_arrays(
-                    it.second.get());
+                    archetype_map_[i]);
             }
         }
 
@@ -38,9 +73,16 @@ namespace ant {
          * \return created entityID
          */
         entity_t create(chunk_id_t chunk_id = _null_chunk) {
-            entity_t entity_t = entity_id_dispenser.get();
-            entity_index_->emplace(entity_t, record_t{nullptr, 0, chunk_id});
-            return entity_t;
+            check_structural_change();
+            return entity_index_->create(chunk_id);
+        }
+
+        /**
+         * @brief whether entity is alive, handles of destroyed entities are
+         *        never valid again even once their index is recycled
+         */
+        bool valid(entity_t entity) const {
+            return entity_index_->contains(entity);
         }
 
         /**
@@ -56,14 +98,74 @@ namespace ant {
         template <typename... Cs>
         entity_t create(chunk_id_t chunk_id, Cs&&...);
 
-        /* Not Implemented  !*/
-        void remove(entity_t entity_t) {
-            // TODO REMOVE COMPONENTS
-            entity_id_dispenser.free(entity_t);
-        }
+        /**
+         * @brief create count entities holding copies of the given
+         *        prototypes. the target archetype, its columns and the
+         *        entity index are grown once for the whole batch
+         *
+         * @tparam Cs types of components to create
+         * @param count number of entities to create
+         * @param chunk_id id of the chunk entities have to be placed in
+         * @param prototypes values copied in every created entity
+         * @return std::vector<entity_t> handles to the created entities
+         */
+        template <typename... Cs>
+        std::vector<entity_t> create_n(size_t count, chunk_id_t chunk_id,
+                                       const Cs&... prototypes);
+
+        /**
+         * @brief create count entities whose components are built by init
+         *
+         * @param init called as init(i) for i in [0,count) in order, returns
+         *        a std::tuple<Cs...> moved into the archetype
+         */
+        template <typename... Cs, typename F>
+        requires(std::invocable<F, size_t>) std::vector<entity_t> create_n(
+            size_t count, chunk_id_t chunk_id, F&& init);
+
+        /**
+         * @brief create one entity per element of range, elements are
+         *        std::tuple<Cs...>
+         */
+        template <typename... Cs, std::ranges::input_range R>
+        std::vector<entity_t> create_range(chunk_id_t chunk_id, R&& range);
+
+        /**
+         * @brief destroy the entity and its components, the entity handle
+         *        is no longer valid afterward
+         *
+         * @param entity entity to destroy
+         */
+        void destroy(entity_t entity);
+
+        /**
+         * @brief destroy every entity of the range, entities sharing an
+         *        archetype are removed with a single compaction of it
+         *
+         * @param entities range of entity_t, invalid handles are ignored
+         */
+        template <std::ranges::input_range R>
+        requires(std::same_as<std::ranges::range_value_t<R>, entity_t>) void
+            destroy(R&& entities);
 
         /**
-         * \brief Add Component To given entity_t
+         * @brief destroy every entity matching the arguments of pred for
+         *        which pred returns true, each archetype is compacted once
+         *
+         * @param pred called as for_each functors, returns a bool
+         * @param chunk_id chunk the entities have to be in
+         */
+        template <typename P>
+        void destroy_if(P&& pred, chunk_id_t chunk_id = _null_chunk);
+
+        /**
+         * @brief same as destroy
+         */
+        void remove(entity_t entity) { destroy(entity); }
+
+        /**
+         * \brief Add Component To given entity_t, replacing it if the
+         * entity already holds one
          * \tparam C ComponentType
          * \tparam Args Component Param Type
          * \param entity_t
@@ -90,6 +192,51 @@ namespace ant {
         template <typename... Cs>
         void save();
 
+        /**
+         * \brief observes the additions of C by create, create_n, add and
+         * apply. f(entity_t) is called right after each addition, f(std::
+         * span<const entity_t>) receives the entities at flush_observers
+         * grouped by the archetype they entered. immediate observers must
+         * not create, destroy, add or remove, that throws std::logic_error
+         * \return id to disconnect the observer with
+         */
+        template <typename C, typename F>
+        observer_id on_add(F&& f) {
+            return observers_.connect(observer_event::add, column_ids<C>()[0],
+                                      std::forward<F>(f));
+        }
+
+        /**
+         * \brief observes the removals of C by remove, apply and the
+         * destruction of entities holding it, immediate observers are
+         * called right before and can still read C. see on_add
+         */
+        template <typename C, typename F>
+        observer_id on_remove(F&& f) {
+            return observers_.connect(observer_event::remove,
+                                      column_ids<C>()[0], std::forward<F>(f));
+        }
+
+        /**
+         * \brief observes the destruction of entities, by destroy,
+         * destroy_if, unload_chunk and apply, after the on_remove observers
+         * of their components. restore and apply_delta replace entities
+         * without notifying. see on_add
+         */
+        template <typename F>
+        observer_id on_destroy(F&& f) {
+            return observers_.connect(observer_event::destroy, 0,
+                                      std::forward<F>(f));
+        }
+
+        void disconnect(observer_id id) { observers_.disconnect(id); }
+
+        /**
+         * \brief delivers the events queued for the batched observers since
+         * the last flush, the entities may have been destroyed since
+         */
+        void flush_observers() { observers_.flush(); }
+
         /**
          * \brief builds a multiviews from given components in chunkID
          * \tparam Cs Component types to be retrieved
@@ -99,76 +246,1475 @@ namespace ant {
         template <typename... Cs>
         auto get(chunk_id_t chunkid = _null_chunk);
 
+        /**
+         * \brief view of the entities holding Cs that pass the filters,
+         *        exclude<...>, any_of<...> and optional<C>. each optional<C>
+         *        appends a C* to the view elements, null in the archetypes
+         *        lacking C. block filters such as changed<C> aren't
+         *        accepted, views don't skip blocks
+         */
+        template <typename... Cs, query_filter... Filters>
+        requires(sizeof...(Filters) > 0) auto get(chunk_id_t chunk_id,
+                                                  const Filters&... filters);
+
+        template <typename... Cs, query_filter... Filters>
+        requires(sizeof...(Filters) > 0) auto get(const Filters&... filters) {
+            return get<Cs...>(_null_chunk, filters...);
+        }
+
         /**
          * \brief Get all given Component from an entity_t
          * \tparam Cs ComponentTypes to retrieve
          * \param entity_t
          * \return tuple of component refereces ;
+         * \throw std::out_of_range if the entity lacks a sparse component
          */
         template <typename... Cs>
         std::tuple<Cs&...> get_entity_components(entity_t entity_t);
 
+        /**
+         * \brief calls f(entity_t, Cs...) on every entity of the chunk
+         * holding the components f takes by reference. sparse components
+         * are joined entity by entity: when f takes some by reference the
+         * smallest of their sets is walked and the other components looked
+         * up, a C* parameter is null for the entities lacking C
+         */
         template <typename F>
         void for_each(F&& f, chunk_id_t chunk_id = _null_chunk);
 
+        /**
+         * \brief for_each restricted by filters: exclude<Cs...> and
+         * any_of<Cs...> skip whole archetypes, changed<C>{since} and
+         * added<C>{since} skip the blocks they reject and require C. C*
+         * parameters of f are optional components, null for the archetypes
+         * lacking them. const reference parameters of f don't count as
+         * changes
+         */
+        template <typename F, query_filter... Filters>
+        requires(sizeof...(Filters) > 0) void for_each(
+            F&& f, chunk_id_t chunk_id, const Filters&... filters);
+
+        template <typename F, query_filter... Filters>
+        requires(sizeof...(Filters) > 0) void for_each(
+            F&& f, const Filters&... filters) {
+            for_each(std::forward<F>(f), _null_chunk, filters...);
+        }
+
+        /**
+         * \brief calls f(std::span<const entity_t>, std::span<Cs>...) once
+         * per run of contiguous rows: a whole archetype with contiguous
+         * storage, a block with chunked storage. the spans of a call never
+         * overlap and start on _column_alignment (see aligned_data), so f
+         * can be written as plain loops for the compiler to vectorize.
+         * std::span<const C> parameters don't count as changes
+         * \param filters as for for_each, block filters skip whole spans.
+         * tags can't be spanned but can be filtered on
+         */
+        template <typename F, query_filter... Filters>
+        void for_each_span(F&& f, chunk_id_t chunk_id,
+                           const Filters&... filters);
+
+        template <typename F, query_filter... Filters>
+        void for_each_span(F&& f, const Filters&... filters) {
+            for_each_span(std::forward<F>(f), _null_chunk, filters...);
+        }
+
+        /**
+         * \brief calls f on every matching entity from the worker threads,
+         * archetypes are split per block when chunked and in row ranges of
+         * _parallel_grain rows otherwise. f is shared by every task and must
+         * be safe to call concurrently on distinct entities. creating,
+         * destroying, adding or removing components while it runs throws
+         * std::logic_error, the first exception thrown by f is rethrown once
+         * every task is done
+         * \param f callable taking entity_t then component references
+         * \param chunk_id chunk the entities have to be in
+         */
+        template <typename F>
+        void par_for_each(F&& f, chunk_id_t chunk_id = _null_chunk);
+
+        /**
+         * \brief plays back the commands recorded in buffer then clears it.
+         * the commands of each entity are folded into the archetype it ends
+         * up in, entities are then destroyed in bulk and moved from their
+         * archetype to the next in groups sharing both, so an entity moves
+         * at most once whatever the number of commands targeting it.
+         * commands targeting entities that are no longer valid are dropped
+         * \param buffer commands to play back
+         */
+        void apply(command_buffer& buffer);
+
+        /**
+         * \brief plays back every per thread buffer of buffers
+         */
+        void apply(concurrent_command_buffer& buffers) {
+            buffers.for_each_buffer(
+                [&](command_buffer& buffer) { apply(buffer); });
+        }
+
+        /**
+         * @brief number of threads par_for_each runs on, calling thread
+         *        included, defaults to std::thread::hardware_concurrency.
+         *        with a single one par_for_each runs inline
+         */
+        void set_worker_count(size_t worker_count) {
+            check_structural_change();
+            worker_count_ = std::max<size_t>(worker_count, 1);
+            thread_pool_.reset();
+        }
+
+        /**
+         * \brief builds a persistent query over given components in chunkID,
+         * its matching archetypes are updated as archetypes are created and
+         * deleted instead of being searched on each iteration
+         * \tparam Cs Component types to be retrieved
+         * \param chunk_id chunk the entities have to be in
+         * \return a query<Cs...> valid as long as the registry
+         */
+        template <typename... Cs>
+        ant::query<Cs...> query(chunk_id_t chunk_id = _null_chunk);
+
+        /**
+         * @brief archetypes left empty by add / remove are kept so that
+         *        repeated transitions stay cheap, release them
+         */
+        void collect_empty_archetypes() {
+            check_structural_change();
+            archetype_map_.delete_empty_archetypes();
+        }
+
+        /**
+         * \brief destroys every entity of the chunk at once and releases its
+         * archetypes, entities without components included
+         * \param chunk_id chunk to unload
+         */
+        void unload_chunk(chunk_id_t chunk_id);
+
+        /**
+         * \brief moves every entity of a chunk to another by retagging its
+         * archetypes, components stay where they are in memory. entities
+         * without components are retagged too
+         * \throw std::runtime_error if to already holds entities sharing an
+         * archetype signature with from, nothing is moved then
+         */
+        void move_chunk(chunk_id_t from, chunk_id_t to);
+
+        /**
+         * \brief moves every entity of from to into. archetypes of from are
+         * retagged as by move_chunk, unless into has entities of the same
+         * signature, in which case they are appended to them
+         */
+        void merge_chunks(chunk_id_t from, chunk_id_t into);
+
+        /**
+         * \brief writes the entity index and every archetype holding
+         * entities to out, each component column as a contiguous blob per
+         * block. trivially copyable components are dumped as is, others need
+         * a component_serializer specialization. the format is native endian
+         * and identifies components by typeid name, so it is meant to be
+         * read back by the same build
+         * \throw std::runtime_error if an entity holds a sparse component,
+         * checked before writing anything, if a component can't be
+         * serialized or out fails, out is then left partially written
+         */
+        void snapshot(std::ostream& out);
+
+        /**
+         * \brief replaces every entity by the ones of a snapshot, handles
+         * taken before the snapshot stay valid. each archetype is allocated
+         * once and its columns read in place. the components of the snapshot
+         * have to be registered, e.g through save
+         * \throw std::runtime_error if the snapshot has a wrong header or
+         * holds unknown components, checked first so that the registry is
+         * left unchanged, or if it is truncated or corrupted, the registry
+         * is then left empty
+         */
+        void restore(std::istream& in);
+
+        /**
+         * \brief like snapshot, but each column is written as a page aligned
+         * blob that restore_mapped maps instead of reading, so that only the
+         * entity index and the archetype descriptors are parsed on load
+         * \throw std::runtime_error if an entity holds a sparse component,
+         * a component isn't trivially copyable or the file can't be written
+         */
+        void snapshot_mapped(const std::string& path);
+
+        /**
+         * \brief replaces every entity by the ones of a snapshot_mapped file.
+         * the file is mapped privately and its pages are used as the columns
+         * in place, they are read from disk on first access and copied by
+         * the os on first write, so the file is never modified. a column is
+         * copied to memory of its own the first time it grows. the mapping
+         * lives until the next restore or the registry destruction
+         * \throw std::logic_error if the storage isn't contiguous
+         * \throw std::runtime_error like restore, or if memory mapping isn't
+         * supported on the platform
+         */
+        void restore_mapped(const std::string& path);
+
+        /**
+         * \brief starts a new epoch, the changes made from now on are tagged
+         * with it until the next checkpoint
+         * \return the new epoch, snapshot_delta(out, epoch) later writes the
+         * changes made since this call
+         */
+        uint64_t checkpoint() { return entity_index_->advance_epoch(); }
+
+        /**
+         * \brief epoch the changes are currently tagged with
+         */
+        uint64_t epoch() const { return entity_index_->epoch(); }
+
+        /**
+         * \brief writes the changes made at or after epoch since, to be
+         * applied on a registry holding the state at that time (a restored
+         * snapshot taken right before the checkpoint that returned since,
+         * and the deltas taken since then). archetypes whose rows were
+         * added, removed or moved are written in full, the others only
+         * with their blocks handed out for writing: by for_each,
+         * par_for_each and query::for_each to non const reference
+         * parameters, by views and queries of non const components and by
+         * get_entity_components. a block handed out counts as changed even
+         * if it wasn't written. the entity index is written by batches of
+         * records holding a change
+         * \throw std::runtime_error like snapshot
+         */
+        void snapshot_delta(std::ostream& out, uint64_t since);
+
+        /**
+         * \brief applies the output of snapshot_delta, the registry has to
+         * hold the state the delta was taken from
+         * \throw std::runtime_error like restore, the registry is left
+         * unchanged by a wrong header and empty otherwise
+         */
+        void apply_delta(std::istream& in);
+
        private:
+        friend class scheduler;
+
+        // archetypes holding entities and the table of their components,
+        // positions maps a component id to its place in the table
+        struct snapshot_layout {
+            std::vector<archetype*> archetypes;
+            std::vector<component_id_t> components;
+            std::vector<uint32_t> positions;
+        };
+
+        snapshot_layout snapshot_layout_of();
+        void write_snapshot_header(std::ostream& out, uint64_t magic,
+                                   const snapshot_layout& layout);
+        /**
+         * @brief writes the chunk, the components, tags included, and the
+         *        row count
+         */
+        void write_archetype_key(std::ostream& out,
+                                 const snapshot_layout& layout,
+                                 archetype* arch);
+        /**
+         * @return id of the components of the snapshot table
+         */
+        std::vector<component_id_t> read_snapshot_header(std::istream& in,
+                                                         uint64_t magic);
+        /**
+         * @brief reads the output of write_archetype_key
+         * @return the archetype, created if needed
+         */
+        archetype* read_archetype_key(
+            std::istream& in, const std::vector<component_id_t>& components,
+            std::vector<component_id_t>& column_components, size_t& count);
+        /**
+         * @brief reads count entities, which have to be alive
+         */
+        void read_entities(std::istream& in, std::vector<entity_t>& entities,
+                           size_t count);
+        void bind_records(archetype* arch,
+                          const std::vector<entity_t>& entities);
+        /**
+         * @brief unbind the records still bound to the rows of arch then
+         *        destroy them
+         */
+        void clear_archetype(archetype* arch);
+        void clear_for_restore();
+
         template <typename C>
         void save_impl();
 
+        /**
+         * @brief whether C, the fields of a soa component, were saved
+         */
+        template <typename C>
+        bool registered() const {
+            if constexpr (sparse_component<C>) {
+                return find_sparse(type_id_generator::get<C>()) != nullptr;
+            } else {
+                return component_map_->contains(column_ids<C>()[0]);
+            }
+        }
+
+        void register_component(component_id_t component_id,
+                                std::unique_ptr<component_base> component,
+                                const char* name) {
+            component_map_->emplace(component_id, std::move(component));
+            registry_debugger_.on_component_registration(component_id, name);
+            archetype_map_.on_component_registration(component_id);
+        }
+
+        /**
+         * @brief locks structural changes from its construction to its
+         *        destruction, exceptions included
+         */
+        class structure_lock {
+           public:
+            explicit structure_lock(std::atomic<uint32_t>& locks)
+                : locks_(locks),
+                  nested_(locks.fetch_add(1, std::memory_order_acq_rel) > 0) {}
+
+            ~structure_lock() {
+                locks_.fetch_sub(1, std::memory_order_acq_rel);
+            }
+
+            structure_lock(const structure_lock&) = delete;
+            structure_lock& operator=(const structure_lock&) = delete;
+
+            /**
+             * @brief whether structural changes were already locked, e.g by
+             *        the scheduler running the caller
+             */
+            [[nodiscard]] bool nested() const noexcept { return nested_; }
+
+           private:
+            std::atomic<uint32_t>& locks_;
+            bool nested_;
+        };
+
+        /**
+         * @brief archetypes must not move while par_for_each or a
+         *        scheduler walks them, nor while observers are notified
+         */
+        void check_structural_change() const {
+            if (parallel_iterations_.load(std::memory_order_acquire) > 0) {
+                throw std::logic_error(
+                    "structural change during a parallel iteration or an "
+                    "observer");
+            }
+        }
+
+        /**
+         * @brief notifies the observers of an event on component_id with
+         *        structural changes locked
+         * \param arch archetype the entities entered or left
+         */
+        void notify(observer_event event, component_id_t component_id,
+                    const archetype* arch,
+                    std::span<const entity_t> entities) {
+            if (!observers_.observed(event, component_id)) {
+                return;
+            }
+            const structure_lock lock(parallel_iterations_);
+            observers_.notify(event, component_id, arch, entities);
+        }
+
+        /**
+         * @brief notifies an add or remove event for each of components
+         */
+        void notify_each(observer_event event, const signature_t& components,
+                         const archetype* arch,
+                         std::span<const entity_t> entities) {
+            const signature_t& observed = observers_.observed(event);
+            if (components.intersects(observed)) {
+                (components & observed).for_each([&](size_t component_id) {
+                    notify(event, static_cast<component_id_t>(component_id),
+                           arch, entities);
+                });
+            }
+        }
+
+        /**
+         * @brief whether destroying entities of arch has to notify
+         */
+        [[nodiscard]] bool destroy_observed(const archetype* arch) const {
+            return observers_.observed(observer_event::destroy, 0)
+                   || (arch
+                       && arch->key.signature.intersects(
+                           observers_.observed(observer_event::remove)));
+        }
+
+        /**
+         * @brief entities of arch about to be destroyed, their components
+         *        are removed then they are destroyed
+         */
+        void notify_destroy(const archetype* arch,
+                            std::span<const entity_t> entities) {
+            if (arch) {
+                notify_each(observer_event::remove, arch->key.signature, arch,
+                            entities);
+            }
+            notify(observer_event::destroy, 0, arch, entities);
+        }
+
+        /**
+         * @brief set of the sparse component C, created on first use
+         */
+        template <typename C>
+        sparse_set<C>& sparse() {
+            const component_id_t component_id = type_id_generator::get<C>();
+            if (!find_sparse(component_id)) {
+                register_sparse(component_id, make_sparse_set<C>());
+            }
+            return static_cast<sparse_set<C>&>(*sparse_sets_[component_id]);
+        }
+
+        [[nodiscard]] sparse_set_base* find_sparse(
+            component_id_t component_id) const noexcept {
+            return component_id < sparse_sets_.size()
+                       ? sparse_sets_[component_id].get()
+                       : nullptr;
+        }
+
+        void register_sparse(component_id_t component_id,
+                             std::unique_ptr<sparse_set_base> set) {
+            if (component_id >= sparse_sets_.size()) {
+                sparse_sets_.resize(component_id + 1);
+            }
+            sparse_sets_[component_id] = std::move(set);
+            sparse_ids_.push_back(component_id);
+        }
+
+        /**
+         * @brief removes the sparse components of entities about to be
+         *        destroyed
+         */
+        void erase_sparse(std::span<const entity_t> entities) {
+            std::vector<entity_t> removed;
+            for (component_id_t component_id : sparse_ids_) {
+                sparse_set_base& set = *sparse_sets_[component_id];
+                if (set.size() == 0) {
+                    continue;
+                }
+                if (observers_.observed(observer_event::remove,
+                                        component_id)) {
+                    removed.clear();
+                    std::ranges::copy_if(
+                        entities, std::back_inserter(removed),
+                        [&](entity_t entity) { return set.contains(entity); });
+                    notify(observer_event::remove, component_id, nullptr,
+                           removed);
+                }
+                for (entity_t entity : entities) {
+                    set.erase(entity);
+                }
+            }
+        }
+
+        /**
+         * @brief drops the sparse components of the entities that are no
+         *        longer valid
+         */
+        void prune_sparse() {
+            std::vector<entity_t> dead;
+            for (component_id_t component_id : sparse_ids_) {
+                sparse_set_base& set = *sparse_sets_[component_id];
+                dead.clear();
+                std::ranges::copy_if(set.entities(), std::back_inserter(dead),
+                                     [&](entity_t entity) {
+                                         return !entity_index_->contains(
+                                             entity);
+                                     });
+                for (entity_t entity : dead) {
+                    set.erase(entity);
+                }
+            }
+        }
+
+        /**
+         * @brief whether the archetype of entity has the component id
+         */
+        bool holds(entity_t entity, component_id_t component_id) const {
+            const archetype* arch = (*entity_index_)[entity].entity_archetype;
+            return arch && arch->key.signature.test(component_id);
+        }
+
+        /**
+         * @brief component C of entity for get_entity_components
+         */
+        template <typename C>
+        C& entity_component(entity_t entity, const record_t& record) {
+            if constexpr (sparse_component<C>) {
+                sparse_set_base* set
+                    = find_sparse(type_id_generator::get<C>());
+                C* component
+                    = set ? static_cast<sparse_set<std::remove_cv_t<C>>*>(set)
+                                ->find(entity)
+                          : nullptr;
+                if (!component) {
+                    throw std::out_of_range("entity lacks the component");
+                }
+                return *component;
+            } else {
+                archetype_handler_.mark_written<C&>(
+                    record.entity_archetype, record.index, record.index + 1);
+                return archetype_handler_.get_component<C>(
+                    record.entity_archetype, record.index);
+            }
+        }
+
+        /**
+         * @brief for_each of a callable taking sparse components
+         */
+        template <typename F, typename Entity_T, typename... Args,
+                  typename... Filters>
+        void for_each_joined(F& f, type_list<Entity_T, Args...> types,
+                             chunk_id_t chunk_id, const Filters&... filters);
+
+        /**
+         * @brief address of the argument A of f for the entity, null if it
+         *        lacks the component
+         */
+        template <typename A>
+        auto* find_argument(sparse_set_base* set, entity_t entity,
+                            archetype* arch, size_t row);
+
+        thread_pool& get_thread_pool() {
+            if (!thread_pool_) {
+                // the thread calling par_for_each works too
+                thread_pool_ = std::make_unique<thread_pool>(worker_count_ - 1);
+            }
+            return *thread_pool_;
+        }
+
+        /**
+         * @brief reserves ids, records and rows for count entities of the
+         *        archetype holding Cs, construct then writes the components
+         *        of the rows [first_row, first_row + count) and counts them
+         *        per column in built, which is rolled back if it throws
+         */
+        template <typename... Cs, typename Construct>
+        std::vector<entity_t> create_batch(size_t count, chunk_id_t chunk_id,
+                                           Construct&& construct);
+
+        /**
+         * @brief add and remove without notifying, the fields of a soa
+         *        component in a single migration
+         */
+        template <typename C, typename... Args>
+        void add_component(entity_t entity, Args&&... args);
+
+        template <typename C>
+        void remove_component(entity_t entity);
+
+        /**
+         * @brief moves entity to the archetype of target in its chunk, see
+         *        archetype_handler::migrate_entity for value
+         */
+        template <typename Values>
+        void migrate(entity_t entity, const signature_t& target,
+                     Values&& value);
+
+        /**
+         * @brief moves entity to to, whose columns have to be reserved, then
+         *        shrinks the archetype it left
+         */
+        template <typename Values>
+        void migrate_to(entity_t entity, archetype* to, Values&& value);
+
         template <typename C, typename... Args>
         void add_impl(archetype* old_archetype, entity_t entity,
                       record_t record, Args&&... args);
 
         template <typename C>
-        void remove_impl(archetype* old_archetype, entity_t entity,
-                         record_t record);
+        void remove_impl(archetype* old_archetype, entity_t entity);
+
+        void transfer_chunk(chunk_id_t from, chunk_id_t to, bool merge);
 
         std::unique_ptr<entity_index> entity_index_;
         std::unique_ptr<component_map> component_map_;
         archetype_map archetype_map_;
-        unique_id_dispenser<entity_t> entity_id_dispenser;
         archetype_handler archetype_handler_;
         registry_debugger registry_debugger_;
+        observer_map observers_;
+        // indexed by component id, null for the components stored in the
+        // archetypes
+        std::vector<std::unique_ptr<sparse_set_base>> sparse_sets_;
+        std::vector<component_id_t> sparse_ids_;
+
+        size_t worker_count_
+            = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        std::unique_ptr<thread_pool> thread_pool_;
+        std::atomic<uint32_t> parallel_iterations_{0};
+        // scratch of apply(command_buffer&) indexed by entity index, reset
+        // to UINT32_MAX after use
+        std::vector<uint32_t> command_slots_;
+        // files restore_mapped columns may still point into
+        std::vector<std::unique_ptr<mapped_file>> mapped_files_;
     };
 
     template <typename... Cs>
     entity_t registry::create(chunk_id_t chunk_id, Cs&&... cs) {
+        static_assert(!any_sparse_v<std::remove_cvref_t<Cs>...>,
+                      "sparse components are added with add");
+        ((registered<Cs>() ? void() : save<Cs>()), ...);
         entity_t entity = create(chunk_id);
-        signature_t signature;
-        ((signature |= get_type_signature<Cs>()), ...);
         archetype* new_archetype
-            = archetype_map_.get(archetype_key{signature, chunk_id});
+            = archetype_map_.get(archetype_key{get_signature<Cs...>(), chunk_id});
         ((archetype_handler_.insert_component<Cs>(new_archetype,
                                                   std::forward<Cs>(cs))),
          ...);
-        entity_index_->at(entity).entity_archetype = new_archetype;
-        entity_index_->at(entity).index = new_archetype->entities.size();
-        new_archetype->entities.push_back(entity);
+        archetype_handler_.move_entity_to_archetype(new_archetype, entity);
+        notify_each(observer_event::add, new_archetype->key.signature,
+                    new_archetype, {&entity, 1});
         return entity;
     }
 
+    template <typename... Cs>
+    std::vector<entity_t> registry::create_n(size_t count, chunk_id_t chunk_id,
+                                             const Cs&... prototypes) {
+        return create_batch<Cs...>(
+            count, chunk_id,
+            [&](archetype* arch, size_t first_row, std::span<size_t> built) {
+                (archetype_handler_.construct_rows(arch, first_row, count,
+                                                   prototypes, built),
+                 ...);
+            });
+    }
+
+    template <typename... Cs, typename F>
+    requires(std::invocable<F, size_t>) std::vector<entity_t> registry::
+        create_n(size_t count, chunk_id_t chunk_id, F&& init) {
+        return create_batch<Cs...>(
+            count, chunk_id,
+            [&](archetype* arch, size_t first_row, std::span<size_t> built) {
+                // tags have no column, their values are dropped
+                const size_t component_indices[] = {
+                    arch->find_column(type_id_generator::get<Cs>())...};
+                for (size_t i = 0; i < count; ++i) {
+                    auto components = init(i);
+                    size_t column = 0;
+                    (
+                        [&]<typename C>(C&& component) {
+                            const size_t index = component_indices[column++];
+                            if constexpr (soa_component<C>) {
+                                archetype_handler_.construct_rows(
+                                    arch, first_row + i, 1, component, built);
+                            } else if constexpr (!is_tag_v<C>) {
+                                new (arch->get_data(index, first_row + i,
+                                                    sizeof(C)))
+                                    C(std::move(component));
+                                ++built[index];
+                            }
+                        }(std::move(std::get<Cs>(components))),
+                        ...);
+                }
+            });
+    }
+
+    template <typename... Cs, std::ranges::input_range R>
+    std::vector<entity_t> registry::create_range(chunk_id_t chunk_id,
+                                                 R&& range) {
+        if constexpr (std::ranges::sized_range<R>) {
+            auto it = std::ranges::begin(range);
+            return create_n<Cs...>(std::ranges::size(range), chunk_id,
+                                   [&](size_t) { return *it++; });
+        } else {
+            std::vector<std::tuple<Cs...>> values;
+            for (auto&& value : range) {
+                values.emplace_back(std::forward<decltype(value)>(value));
+            }
+            return create_range<Cs...>(chunk_id, values);
+        }
+    }
+
+    template <typename... Cs, typename Construct>
+    std::vector<entity_t> registry::create_batch(size_t count,
+                                                 chunk_id_t chunk_id,
+                                                 Construct&& construct) {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components are added with add");
+        check_structural_change();
+        ((registered<Cs>() ? void() : save<Cs>()), ...);
+        archetype* arch
+            = archetype_map_.get(archetype_key{get_signature<Cs...>(), chunk_id});
+        const size_t first_row = arch->entities.size();
+        archetype_handler_.reserve(arch, first_row + count);
+        std::vector<entity_t> entities;
+        entities.reserve(count);
+        arch->entities.reserve(first_row + count);
+        std::vector<size_t> built(arch->byte_arrays.size(), 0);
+        try {
+            construct(arch, first_row, std::span<size_t>(built));
+        } catch (...) {
+            // the rows aren't in arch->entities yet, nothing else would
+            // destroy them
+            archetype_handler_.destroy_built(arch, first_row, built);
+            throw;
+        }
+
+        entity_index_->create_n(
+            count, record_t{arch, static_cast<index_t>(first_row), chunk_id},
+            std::back_inserter(entities));
+        arch->entities.insert(arch->entities.end(), entities.begin(),
+                              entities.end());
+        archetype_handler_.touch(arch);
+        for (size_t j = 0; j < arch->byte_arrays.size(); j++) {
+            archetype_handler_.mark_added(arch, j, first_row,
+                                          first_row + count);
+        }
+        notify_each(observer_event::add, arch->key.signature, arch, entities);
+        return entities;
+    }
+
+    inline void registry::destroy(entity_t entity) {
+        check_structural_change();
+        const record_t& record = entity_index_->at(entity);
+        erase_sparse({&entity, 1});
+        if (destroy_observed(record.entity_archetype)) {
+            notify_destroy(record.entity_archetype, {&entity, 1});
+        }
+        if (record.entity_archetype) {
+            archetype_handler_.erase_entity(record.entity_archetype,
+                                            record.index);
+        }
+        entity_index_->destroy(entity);
+    }
+
+    inline void registry::unload_chunk(chunk_id_t chunk_id) {
+        check_structural_change();
+        for (archetype* arch : archetype_map_.chunk_archetypes(chunk_id)) {
+            erase_sparse(arch->entities);
+            if (destroy_observed(arch)) {
+                notify_destroy(arch, arch->entities);
+            }
+            for (entity_t entity : arch->entities) {
+                entity_index_->destroy(entity);
+            }
+            // destroys the components of every row block by block
+            archetype_map_.delete_archetype(arch->id);
+        }
+        const auto unstored = entity_index_->unstored_entities(chunk_id);
+        erase_sparse(unstored);
+        if (destroy_observed(nullptr)) {
+            notify_destroy(nullptr, unstored);
+        }
+        for (entity_t entity : unstored) {
+            entity_index_->destroy(entity);
+        }
+    }
+
+    inline void registry::move_chunk(chunk_id_t from, chunk_id_t to) {
+        transfer_chunk(from, to, false);
+    }
+
+    inline void registry::merge_chunks(chunk_id_t from, chunk_id_t into) {
+        transfer_chunk(from, into, true);
+    }
+
+    inline void registry::transfer_chunk(chunk_id_t from, chunk_id_t to,
+                                         bool merge) {
+        check_structural_change();
+        if (from == to) {
+            return;
+        }
+        const auto archetypes = archetype_map_.chunk_archetypes(from);
+        if (!merge) {
+            for (archetype* arch : archetypes) {
+                archetype* target
+                    = archetype_map_.find({arch->key.signature, to});
+                if (target && !target->entities.empty()) {
+                    throw std::runtime_error(
+                        "chunk already holds entities of that archetype");
+                }
+            }
+        }
+        for (archetype* arch : archetypes) {
+            archetype* target = archetype_map_.find({arch->key.signature, to});
+            if (target && target->entities.empty()) {
+                // retagging is cheaper than appending to an empty archetype
+                archetype_map_.delete_archetype(target->id);
+                target = nullptr;
+            }
+            size_t first = 0;
+            if (target) {
+                first = target->entities.size();
+                archetype_handler_.append_entities(target, arch);
+                archetype_map_.delete_archetype(arch->id);
+            } else {
+                archetype_map_.retag(arch, to);
+                archetype_handler_.touch(arch);
+                target = arch;
+            }
+            for (size_t row = first; row < target->entities.size(); row++) {
+                (*entity_index_)[target->entities[row]].chunk_id = to;
+                entity_index_->touch(target->entities[row]);
+            }
+        }
+        for (entity_t entity : entity_index_->unstored_entities(from)) {
+            (*entity_index_)[entity].chunk_id = to;
+            entity_index_->touch(entity);
+        }
+    }
+
+    inline registry::snapshot_layout registry::snapshot_layout_of() {
+        // sparse components aren't serialized, refuse rather than drop them
+        for (component_id_t component_id : sparse_ids_) {
+            if (sparse_sets_[component_id]->size() != 0) {
+                throw std::runtime_error(
+                    "snapshot of entities holding sparse components");
+            }
+        }
+        constexpr uint32_t npos = UINT32_MAX;
+        snapshot_layout layout;
+        std::vector<uint32_t> positions;
+        for (size_t i = 0; i < archetype_map_.size(); ++i) {
+            archetype* arch = archetype_map_[i];
+            if (arch->entities.empty()) {
+                continue;
+            }
+            layout.archetypes.push_back(arch);
+            arch->key.signature.for_each([&](size_t component_id) {
+                if (component_id >= positions.size()) {
+                    positions.resize(component_id + 1, npos);
+                }
+                if (positions[component_id] == npos) {
+                    positions[component_id]
+                        = static_cast<uint32_t>(layout.components.size());
+                    layout.components.push_back(
+                        static_cast<component_id_t>(component_id));
+                }
+            });
+        }
+        layout.positions = std::move(positions);
+        return layout;
+    }
+
+    inline void registry::write_snapshot_header(std::ostream& out,
+                                                uint64_t magic,
+                                                const snapshot_layout& layout) {
+        binary::write(out, magic);
+        binary::write(out, _snapshot_version);
+        binary::write(out, static_cast<uint32_t>(layout.components.size()));
+        for (component_id_t component_id : layout.components) {
+            const auto& component = component_map_->at(component_id);
+            binary::write_string(out, component->name());
+            binary::write(out, static_cast<uint64_t>(component->get_size()));
+        }
+    }
+
+    inline void registry::write_archetype_key(std::ostream& out,
+                                              const snapshot_layout& layout,
+                                              archetype* arch) {
+        binary::write(out, arch->key.chunk_id);
+        binary::write(out, static_cast<uint32_t>(arch->key.signature.count()));
+        arch->key.signature.for_each([&](size_t component_id) {
+            binary::write(out, layout.positions[component_id]);
+        });
+        binary::write(out, static_cast<uint64_t>(arch->entities.size()));
+    }
+
+    inline std::vector<component_id_t> registry::read_snapshot_header(
+        std::istream& in, uint64_t magic) {
+        if (binary::read<uint64_t>(in) != magic) {
+            throw std::runtime_error("not a snapshot");
+        }
+        if (binary::read<uint32_t>(in) != _snapshot_version) {
+            throw std::runtime_error("unsupported snapshot version");
+        }
+        // component ids differ from one run to the next, match them by name
+        std::vector<component_id_t> components(binary::read<uint32_t>(in));
+        for (component_id_t& component_id : components) {
+            const std::string name = binary::read_string(in);
+            const size_t size = binary::read<uint64_t>(in);
+            auto it = std::find_if(
+                component_map_->begin(), component_map_->end(),
+                [&](const auto& entry) { return name == entry.second->name(); });
+            if (it == component_map_->end()) {
+                throw std::runtime_error("unregistered snapshot component "
+                                         + name);
+            }
+            if (it->second->get_size() != size) {
+                throw std::runtime_error("snapshot component size mismatch "
+                                         + name);
+            }
+            component_id = it->first;
+        }
+        return components;
+    }
+
+    inline archetype* registry::read_archetype_key(
+        std::istream& in, const std::vector<component_id_t>& components,
+        std::vector<component_id_t>& column_components, size_t& count) {
+        const chunk_id_t chunk_id = binary::read<chunk_id_t>(in);
+        const uint32_t component_count = binary::read<uint32_t>(in);
+        column_components.clear();
+        signature_t signature;
+        for (uint32_t i = 0; i < component_count; ++i) {
+            const uint32_t position = binary::read<uint32_t>(in);
+            if (position >= components.size()) {
+                throw std::runtime_error("corrupted snapshot");
+            }
+            const component_id_t component_id = components[position];
+            signature.set(component_id);
+            if (!component_map_->at(component_id)->is_tag()) {
+                column_components.push_back(component_id);
+            }
+        }
+        count = binary::read<uint64_t>(in);
+        archetype* arch = archetype_map_.get({std::move(signature), chunk_id});
+        if (arch->component_ids.size() != column_components.size()) {
+            throw std::runtime_error("corrupted snapshot");
+        }
+        return arch;
+    }
+
+    inline void registry::read_entities(std::istream& in,
+                                        std::vector<entity_t>& entities,
+                                        size_t count) {
+        entities.resize(count);
+        binary::read_bytes(in, entities.data(), count * sizeof(entity_t));
+        if (std::ranges::any_of(entities, [&](entity_t entity) {
+                return !entity_index_->contains(entity);
+            })) {
+            throw std::runtime_error("corrupted snapshot");
+        }
+    }
+
+    inline void registry::bind_records(archetype* arch,
+                                       const std::vector<entity_t>& entities) {
+        arch->entities.assign(entities.begin(), entities.end());
+        for (size_t row = 0; row < entities.size(); row++) {
+            record_t& record = (*entity_index_)[entities[row]];
+            record.entity_archetype = arch;
+            record.index = static_cast<index_t>(row);
+        }
+        archetype_handler_.touch(arch);
+    }
+
+    inline void registry::clear_archetype(archetype* arch) {
+        for (entity_t entity : arch->entities) {
+            if (get_entity_index(entity) < entity_index_->extent()) {
+                record_t& record = (*entity_index_)[entity];
+                if (record.entity_archetype == arch) {
+                    record.entity_archetype = nullptr;
+                    record.index = 0;
+                }
+            }
+        }
+        archetype_handler_.clear_rows(arch);
+    }
+
+    inline void registry::clear_for_restore() {
+        archetype_map_.clear();
+        // sparse components aren't part of the snapshots
+        for (component_id_t component_id : sparse_ids_) {
+            sparse_sets_[component_id]->clear();
+        }
+        // nothing borrows from the mappings anymore
+        mapped_files_.clear();
+    }
+
+    inline void registry::snapshot(std::ostream& out) {
+        // components of the archetypes holding entities, archetypes refer to
+        // them by their position in the table
+        const snapshot_layout layout = snapshot_layout_of();
+        write_snapshot_header(out, _snapshot_magic, layout);
+        entity_index_->snapshot(out);
+        binary::write(out, static_cast<uint64_t>(layout.archetypes.size()));
+        for (archetype* arch : layout.archetypes) {
+            write_archetype_key(out, layout, arch);
+            binary::write_bytes(out, arch->entities.data(),
+                                arch->entities.size() * sizeof(entity_t));
+            archetype_handler_.write_columns(out, arch);
+        }
+    }
+
+    inline void registry::restore(std::istream& in) {
+        check_structural_change();
+        const std::vector<component_id_t> components
+            = read_snapshot_header(in, _snapshot_magic);
+
+        clear_for_restore();
+        try {
+            entity_index_->restore(in);
+            const size_t archetype_count = binary::read<uint64_t>(in);
+            std::vector<component_id_t> column_components;
+            std::vector<entity_t> entities;
+            for (size_t i = 0; i < archetype_count; i++) {
+                size_t count;
+                archetype* arch = read_archetype_key(in, components,
+                                                     column_components, count);
+                read_entities(in, entities, count);
+                if (!arch->entities.empty()) {
+                    throw std::runtime_error("corrupted snapshot");
+                }
+                archetype_handler_.reserve(arch, entities.size());
+                archetype_handler_.read_columns(in, arch, column_components,
+                                                entities.size());
+                bind_records(arch, entities);
+            }
+        } catch (...) {
+            archetype_map_.clear();
+            entity_index_->clear();
+            throw;
+        }
+    }
+
+    inline void registry::snapshot_mapped(const std::string& path) {
+        const snapshot_layout layout = snapshot_layout_of();
+        for (component_id_t component_id : layout.components) {
+            const auto& component = component_map_->at(component_id);
+            if (!component->is_trivially_copyable()) {
+                throw std::runtime_error(
+                    std::string("mapped snapshot of a component that isn't "
+                                "trivially copyable ")
+                    + component->name());
+            }
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("can't open " + path);
+        }
+        const auto pad = [&out] {
+            static constexpr char zeros[mapped_file::_page_size] = {};
+            const size_t position = static_cast<size_t>(out.tellp());
+            binary::write_bytes(out, zeros,
+                                (mapped_file::_page_size
+                                 - position % mapped_file::_page_size)
+                                    % mapped_file::_page_size);
+        };
+
+        write_snapshot_header(out, _mapped_snapshot_magic, layout);
+        // page aligned payloads, in the order of the archetype descriptors
+        std::vector<uint64_t> offsets;
+        for (archetype* arch : layout.archetypes) {
+            for (size_t j = 0; j < arch->byte_arrays.size(); j++) {
+                pad();
+                offsets.push_back(static_cast<uint64_t>(out.tellp()));
+                archetype_handler_.write_column(out, arch, j);
+            }
+        }
+        const uint64_t metadata = static_cast<uint64_t>(out.tellp());
+        entity_index_->snapshot(out);
+        binary::write(out, static_cast<uint64_t>(layout.archetypes.size()));
+        size_t offset = 0;
+        for (archetype* arch : layout.archetypes) {
+            write_archetype_key(out, layout, arch);
+            binary::write_bytes(out, arch->entities.data(),
+                                arch->entities.size() * sizeof(entity_t));
+            for (size_t j = 0; j < arch->byte_arrays.size(); j++) {
+                binary::write(out, offsets[offset++]);
+            }
+        }
+        binary::write(out, metadata);
+        out.flush();
+        if (!out) {
+            throw std::runtime_error("snapshot write failed");
+        }
+    }
+
+    inline void registry::restore_mapped(const std::string& path) {
+        check_structural_change();
+        if (archetype_map_.config().policy != storage_policy::contiguous) {
+            throw std::logic_error(
+                "mapped snapshots need contiguous storage");
+        }
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("can't open " + path);
+        }
+        const std::vector<component_id_t> components
+            = read_snapshot_header(in, _mapped_snapshot_magic);
+        auto file = std::make_unique<mapped_file>(path);
+        if (file->size() < sizeof(uint64_t)) {
+            throw std::runtime_error("truncated snapshot");
+        }
+        uint64_t metadata;
+        std::memcpy(&metadata, file->data() + file->size() - sizeof(uint64_t),
+                    sizeof(uint64_t));
+        if (metadata > file->size() - sizeof(uint64_t)
+            || !in.seekg(static_cast<std::streamoff>(metadata))) {
+            throw std::runtime_error("corrupted snapshot");
+        }
+
+        clear_for_restore();
+        try {
+            entity_index_->restore(in);
+            const size_t archetype_count = binary::read<uint64_t>(in);
+            std::vector<component_id_t> column_components;
+            std::vector<entity_t> entities;
+            for (size_t i = 0; i < archetype_count; i++) {
+                size_t count;
+                archetype* arch = read_archetype_key(in, components,
+                                                     column_components, count);
+                read_entities(in, entities, count);
+                if (!arch->entities.empty()) {
+                    throw std::runtime_error("corrupted snapshot");
+                }
+                for (component_id_t component_id : column_components) {
+                    const uint64_t offset = binary::read<uint64_t>(in);
+                    const size_t size
+                        = component_map_->at(component_id)->get_size()
+                          * entities.size();
+                    if (offset % mapped_file::_page_size != 0
+                        || offset > metadata || size > metadata - offset) {
+                        throw std::runtime_error("corrupted snapshot");
+                    }
+                    archetype_handler_.borrow_column(
+                        arch, component_id, file->data() + offset, size);
+                }
+                bind_records(arch, entities);
+            }
+        } catch (...) {
+            archetype_map_.clear();
+            entity_index_->clear();
+            throw;
+        }
+        mapped_files_.push_back(std::move(file));
+    }
+
+    inline void registry::snapshot_delta(std::ostream& out, uint64_t since) {
+        const snapshot_layout layout = snapshot_layout_of();
+        write_snapshot_header(out, _delta_snapshot_magic, layout);
+        entity_index_->snapshot_delta(out, since);
+        binary::write(out, static_cast<uint64_t>(layout.archetypes.size()));
+        std::vector<std::pair<uint32_t, uint64_t>> blocks;
+        for (archetype* arch : layout.archetypes) {
+            write_archetype_key(out, layout, arch);
+            const bool rebuilt = arch->structure_epoch >= since;
+            binary::write(out, static_cast<uint8_t>(rebuilt));
+            if (rebuilt) {
+                binary::write_bytes(out, arch->entities.data(),
+                                    arch->entities.size() * sizeof(entity_t));
+                archetype_handler_.write_columns(out, arch);
+                continue;
+            }
+            blocks.clear();
+            for (size_t j = 0; j < arch->byte_arrays.size(); j++) {
+                for (size_t block = 0; block < arch->block_count(); block++) {
+                    if (arch->block_written(j, block, since)) {
+                        blocks.emplace_back(static_cast<uint32_t>(j), block);
+                    }
+                }
+            }
+            // blocks are only comparable between archetypes of same layout
+            binary::write(out, static_cast<uint64_t>(arch->block_shift));
+            binary::write(out, static_cast<uint64_t>(blocks.size()));
+            for (auto [column, block] : blocks) {
+                binary::write(out, column);
+                binary::write(out, block);
+                archetype_handler_.write_block(out, arch, column, block);
+            }
+        }
+    }
+
+    inline void registry::apply_delta(std::istream& in) {
+        check_structural_change();
+        const std::vector<component_id_t> components
+            = read_snapshot_header(in, _delta_snapshot_magic);
+        try {
+            entity_index_->apply_delta(in);
+            const size_t archetype_count = binary::read<uint64_t>(in);
+            std::vector<archetype*> listed;
+            std::vector<component_id_t> column_components;
+            std::vector<entity_t> entities;
+            for (size_t i = 0; i < archetype_count; i++) {
+                size_t count;
+                archetype* arch = read_archetype_key(in, components,
+                                                     column_components, count);
+                listed.push_back(arch);
+                if (binary::read<uint8_t>(in)) {
+                    read_entities(in, entities, count);
+                    clear_archetype(arch);
+                    archetype_handler_.reserve(arch, entities.size());
+                    archetype_handler_.read_columns(
+                        in, arch, column_components, entities.size());
+                    bind_records(arch, entities);
+                    continue;
+                }
+                if (count != arch->entities.size()) {
+                    throw std::runtime_error("corrupted snapshot");
+                }
+                if (binary::read<uint64_t>(in) != arch->block_shift) {
+                    throw std::runtime_error("snapshot storage mismatch");
+                }
+                const size_t blocks = binary::read<uint64_t>(in);
+                for (size_t b = 0; b < blocks; b++) {
+                    const uint32_t position = binary::read<uint32_t>(in);
+                    const uint64_t block = binary::read<uint64_t>(in);
+                    if (position >= column_components.size()
+                        || block >= arch->block_count()) {
+                        throw std::runtime_error("corrupted snapshot");
+                    }
+                    archetype_handler_.read_block(
+                        in, arch, arch->column(column_components[position]),
+                        block);
+                }
+            }
+            // the archetypes missing from the delta were emptied
+            std::ranges::sort(listed);
+            for (size_t i = 0; i < archetype_map_.size(); ++i) {
+                archetype* arch = archetype_map_[i];
+                if (!arch->entities.empty()
+                    && !std::ranges::binary_search(listed, arch)) {
+                    clear_archetype(arch);
+                }
+            }
+        } catch (...) {
+            archetype_map_.clear();
+            entity_index_->clear();
+            prune_sparse();
+            throw;
+        }
+        // sparse components aren't part of the deltas, the ones of the
+        // entities destroyed by it are dropped
+        prune_sparse();
+    }
+
+    template <std::ranges::input_range R>
+    requires(std::same_as<std::ranges::range_value_t<R>, entity_t>) void registry::
+        destroy(R&& entities) {
+        check_structural_change();
+        std::vector<entity_t> destroyed;
+        for (entity_t entity : entities) {
+            if (entity_index_->contains(entity)) {
+                destroyed.push_back(entity);
+            }
+        }
+        std::ranges::sort(destroyed);
+        destroyed.erase(std::unique(destroyed.begin(), destroyed.end()),
+                        destroyed.end());
+        erase_sparse(destroyed);
+
+        std::vector<std::pair<archetype*, size_t>> rows;
+        // entities without components, only kept to be notified
+        std::vector<entity_t> bare;
+        for (entity_t entity : destroyed) {
+            const record_t& record = (*entity_index_)[entity];
+            if (record.entity_archetype) {
+                rows.emplace_back(record.entity_archetype, record.index);
+            } else if (destroy_observed(nullptr)) {
+                bare.push_back(entity);
+            }
+        }
+        std::ranges::sort(rows);
+        notify_destroy(nullptr, bare);
+
+        std::vector<size_t> archetype_rows;
+        std::vector<entity_t> archetype_entities;
+        for (auto first = rows.begin(); first != rows.end();) {
+            auto last = std::find_if(first, rows.end(), [&](const auto& row) {
+                return row.first != first->first;
+            });
+            archetype_rows.clear();
+            for (auto it = first; it != last; ++it) {
+                archetype_rows.push_back(it->second);
+            }
+            if (destroy_observed(first->first)) {
+                archetype_entities.clear();
+                for (size_t row : archetype_rows) {
+                    archetype_entities.push_back(first->first->entities[row]);
+                }
+                notify_destroy(first->first, archetype_entities);
+            }
+            archetype_handler_.erase_entities(first->first, archetype_rows);
+            first = last;
+        }
+
+        for (entity_t entity : destroyed) {
+            entity_index_->destroy(entity);
+        }
+    }
+
+    template <typename P>
+    void registry::destroy_if(P&& pred, chunk_id_t chunk_id) {
+        check_structural_change();
+        typename functor_traits<P>::args_type types;
+        static_assert(!sparse_arguments_v<decltype(types)>,
+                      "destroy_if can't take sparse components");
+
+        archetype_key include{get_signature(types), chunk_id};
+        std::vector<size_t> rows;
+        std::vector<entity_t> destroyed;
+        archetype_map_.for_each_matching(include, [&](archetype* arch) {
+            rows.clear();
+            archetype_handler_.apply(
+                [&, row = size_t{0}](auto&&... args) mutable {
+                    if (pred(std::forward<decltype(args)>(args)...)) {
+                        rows.push_back(row);
+                    }
+                    row++;
+                },
+                types, arch);
+            const size_t first = destroyed.size();
+            for (auto row : rows) {
+                destroyed.push_back(arch->entities[row]);
+            }
+            const auto entities = std::span(destroyed).subspan(first);
+            erase_sparse(entities);
+            if (destroy_observed(arch)) {
+                notify_destroy(arch, entities);
+            }
+            archetype_handler_.erase_entities(arch, rows);
+        });
+        for (entity_t entity : destroyed) {
+            entity_index_->destroy(entity);
+        }
+    }
+
     template <typename C, typename... Args>
     void registry::add(entity_t entity, Args&&... args) {
+        check_structural_change();
         if (!entity_index_->contains(entity)) {
             throw std::runtime_error("unregisterd entity_t");
         }
-        if (!component_map_->contains(type_id_generator::get<C>())) {
-            save<C>();
+        if constexpr (sparse_component<C>) {
+            // toggled without moving the entity, adding it again replaces
+            // the value
+            sparse_set<C>& set = sparse<C>();
+            const bool added = !set.contains(entity);
+            set.emplace(entity, std::forward<Args>(args)...);
+            if (!added) {
+                return;
+            }
+        } else {
+            // replacing a held component isn't reported as an add
+            const bool held = holds(entity, column_ids<C>()[0]);
+            add_component<C>(entity, std::forward<Args>(args)...);
+            if (held) {
+                return;
+            }
         }
-        add_impl<C>(entity_index_->at(entity).entity_archetype, entity,
-                    entity_index_->at(entity), std::forward<Args...>(args...));
+        notify(observer_event::add, column_ids<C>()[0],
+               (*entity_index_)[entity].entity_archetype, {&entity, 1});
     }
 
     template <typename C>
     void registry::remove(entity_t entity) {
+        check_structural_change();
         if (!entity_index_->contains(entity)) {
             throw std::runtime_error("unregisterd entity_t");
         }
-        if (!component_map_->contains(type_id_generator::get<C>())) {
-            save<C>();
+        if constexpr (sparse_component<C>) {
+            // removing a missing sparse component does nothing
+            sparse_set_base* set = find_sparse(type_id_generator::get<C>());
+            if (!set || !set->contains(entity)) {
+                return;
+            }
+        } else if (!holds(entity, column_ids<C>()[0])) {
+            return;
+        }
+        notify(observer_event::remove, column_ids<C>()[0],
+               (*entity_index_)[entity].entity_archetype, {&entity, 1});
+        if constexpr (sparse_component<C>) {
+            sparse<C>().erase(entity);
+        } else {
+            remove_component<C>(entity);
+        }
+    }
+
+    template <typename C, typename... Args>
+    void registry::add_component(entity_t entity, Args&&... args) {
+        if constexpr (soa_component<C>) {
+            if (!registered<C>()) {
+                save<C>();
+            }
+            const C value(std::forward<Args>(args)...);
+            const record_t& record = (*entity_index_)[entity];
+            archetype* from = record.entity_archetype;
+            signature_t target = from ? from->key.signature : signature_t{};
+            target |= get_signature<C>();
+            [&]<size_t... Is>(std::index_sequence<Is...>) {
+                using fields_type = std::tuple<soa_field<C, Is>...>;
+                if (from && from->key.signature == target) {
+                    // already held, the fields are replaced in place
+                    ((archetype_handler_.get_component<soa_field<C, Is>>(
+                          from, record.index)
+                      = soa_field<C, Is>{value.*soa_member<C, Is>}),
+                     ...);
+                    archetype_handler_.mark_written<soa_field<C, Is>&...>(
+                        from, record.index, record.index + 1);
+                    return;
+                }
+                // relocated field by field by the migration, never
+                // destroyed as a whole
+                alignas(fields_type) std::byte storage[sizeof(fields_type)];
+                auto* fields = new (storage)
+                    fields_type{soa_field<C, Is>{value.*soa_member<C, Is>}...};
+                const std::array<std::byte*, sizeof...(Is)> values{
+                    reinterpret_cast<std::byte*>(&std::get<Is>(*fields))...};
+                migrate(entity, target, [&](component_id_t component_id) {
+                    const auto& ids = column_ids<C>();
+                    const auto it = std::find(ids.begin(), ids.end(),
+                                              component_id);
+                    return it != ids.end() ? values[it - ids.begin()]
+                                           : nullptr;
+                });
+            }(std::make_index_sequence<soa_field_count<C>>{});
+        } else {
+            if (!registered<C>()) {
+                save<C>();
+            }
+            const record_t& record = (*entity_index_)[entity];
+            add_impl<C>(record.entity_archetype, entity, record,
+                        std::forward<Args>(args)...);
+        }
+    }
+
+    template <typename C>
+    void registry::remove_component(entity_t entity) {
+        if constexpr (soa_component<C>) {
+            if (!registered<C>()) {
+                save<C>();
+            }
+            const archetype* from = (*entity_index_)[entity].entity_archetype;
+            if (from == nullptr) {
+                return;
+            }
+            signature_t target = from->key.signature;
+            target.subtract(get_signature<C>());
+            migrate(entity, target,
+                    [](component_id_t) -> std::byte* { return nullptr; });
+        } else {
+            if (!registered<C>()) {
+                save<C>();
+            }
+            remove_impl<C>((*entity_index_)[entity].entity_archetype, entity);
+        }
+    }
+
+    template <typename Values>
+    void registry::migrate(entity_t entity, const signature_t& target,
+                           Values&& value) {
+        const record_t& record = (*entity_index_)[entity];
+        archetype* to
+            = target.none()
+                  ? nullptr
+                  : archetype_map_.get(archetype_key{target, record.chunk_id});
+        if (to == record.entity_archetype) {
+            return;
+        }
+        if (to) {
+            archetype_handler_.reserve(to, to->entities.size() + 1);
+        }
+        migrate_to(entity, to, std::forward<Values>(value));
+    }
+
+    template <typename Values>
+    void registry::migrate_to(entity_t entity, archetype* to,
+                              Values&& value) {
+        record_t& record = (*entity_index_)[entity];
+        archetype* from = record.entity_archetype;
+        archetype_handler_.migrate_entity(
+            archetype_handler_.plan_migration(from, to), record.index,
+            std::forward<Values>(value));
+        if (from) {
+            // once the row left, so that no dead row is relocated
+            archetype_handler_.shrink(from);
+        }
+        if (to) {
+            archetype_handler_.move_entity_to_archetype(to, entity);
+        } else {
+            record.entity_archetype = nullptr;
+            record.index = 0;
         }
-        remove_impl<C>(entity_index_->at(entity).entity_archetype, entity,
-                       entity_index_->at(entity));
     }
 
     template <typename... Cs>
@@ -178,95 +1724,663 @@ namespace ant {
 
     template <typename C>
     void registry::save_impl() {
-        static_assert(alignof(C) <= sizeof(C),
-                      "Align requirement of a component can not be superior to "
-                      "it's size");
-
-        component_id_t component_type_id
-            = static_cast<component_id_t>(type_id_generator::get<C>());
-        if (component_map_->contains(component_type_id)) {
-            throw std::runtime_error("Trying To Register Component Twice");
+        if constexpr (sparse_component<C>) {
+            if (registered<C>()) {
+                throw std::runtime_error("Trying To Register Component Twice");
+            }
+            sparse<C>();
+        } else if constexpr (soa_component<C>) {
+            [&]<size_t... Is>(std::index_sequence<Is...>) {
+                (save_impl<soa_field<C, Is>>(), ...);
+            }(std::make_index_sequence<soa_field_count<C>>{});
+        } else {
+            component_id_t component_type_id
+                = static_cast<component_id_t>(type_id_generator::get<C>());
+            if (component_map_->contains(component_type_id)) {
+                throw std::runtime_error("Trying To Register Component Twice");
+            }
+            register_component(component_type_id,
+                               std::make_unique<Component<C>>(),
+                               typeid(C).name());
         }
-        component_map_->emplace(component_type_id,
-                                std::make_unique<Component<C>>());
-        registry_debugger_.on_component_registration<C>();
-        archetype_map_.on_component_registration(type_id_generator::get<C>());
     }
 
     template <typename C, typename... Args>
     void registry::add_impl(archetype* old_archetype, entity_t entity,
                             record_t record, Args&&... args) {
+        const component_id_t component_id = type_id_generator::get<C>();
         archetype* new_archetype{nullptr};
         if (old_archetype == nullptr) {
             new_archetype = archetype_map_.get(
                 archetype_key{get_type_signature<C>(), record.chunk_id});
-            archetype_handler_.emplace_component<C>(
-                new_archetype, 0, std::forward<Args>(args)...);
+        } else if (old_archetype->key.signature.test(component_id)) {
+            // already held, the value is replaced in place. it's built
+            // aside first so that a throwing constructor leaves the held
+            // value untouched
+            if constexpr (!is_tag_v<C>) {
+                C value(std::forward<Args>(args)...);
+                if constexpr (std::is_move_assignable_v<C>) {
+                    archetype_handler_.get_component<C>(old_archetype,
+                                                        record.index)
+                        = std::move(value);
+                    archetype_handler_.mark_written<C&>(
+                        old_archetype, record.index, record.index + 1);
+                } else if constexpr (std::is_nothrow_move_constructible_v<C>) {
+                    C* held = &archetype_handler_.get_component<C>(
+                        old_archetype, record.index);
+                    std::destroy_at(held);
+                    std::construct_at(held, std::move(value));
+                    archetype_handler_.mark_written<C&>(
+                        old_archetype, record.index, record.index + 1);
+                } else {
+                    archetype_handler_.replace_through_fresh_row(
+                        old_archetype, record.index, value);
+                }
+            }
+            return;
         } else {
             new_archetype
                 = archetype_map_.get_next_archetype_add<C>(old_archetype);
-
-            archetype_handler_.move_old_comp_and_emplace_new<C>(
-                old_archetype, new_archetype, record.index,
-                std::forward<Args...>(args...));
-
-            archetype_handler_.try_move_last_entity_to(old_archetype,
-                                                       record.index);
-            old_archetype->entities.pop_back();
-
-            if (old_archetype->entities.empty()) {
-                archetype_map_.delete_archetype(old_archetype->key);
-            }
         }
-        entity_index_->at(entity).entity_archetype = new_archetype;
-        entity_index_->at(entity).index = new_archetype->entities.size();
-        new_archetype->entities.push_back(entity);
+        archetype_handler_.reserve(new_archetype,
+                                   new_archetype->entities.size() + 1);
+        if constexpr (is_tag_v<C>) {
+            migrate_to(entity, new_archetype,
+                       [](component_id_t) -> std::byte* { return nullptr; });
+        } else {
+            // relocated into its column by the migration, never destroyed
+            // here
+            alignas(C) std::byte storage[sizeof(C)];
+            new (storage) C(std::forward<Args>(args)...);
+            migrate_to(entity, new_archetype,
+                       [&](component_id_t id) -> std::byte* {
+                           return id == component_id ? storage : nullptr;
+                       });
+        }
     }
 
     template <typename C>
-    void registry::remove_impl(archetype* old_archetype, entity_t entity,
-                               record_t record) {
+    void registry::remove_impl(archetype* old_archetype, entity_t entity) {
+        if (old_archetype == nullptr) {
+            return;
+        }
         archetype* new_archetype
             = archetype_map_.get_next_archetype_remove<C>(old_archetype);
-
-        archetype_handler_.move_comp_to_and_omit<C>(
-            old_archetype, new_archetype, record.index);
-
-        archetype_handler_.try_move_last_entity_to(old_archetype, record.index);
-
-        old_archetype->entities.pop_back();
-
-        if (old_archetype->entities.empty()) {
-            archetype_map_.delete_archetype(old_archetype->key);
+        if (new_archetype == old_archetype) {
+            // C isn't held, nothing to remove
+            return;
         }
         if (new_archetype) {
-            archetype_handler_.move_entity_to_archetype(new_archetype, entity);
+            archetype_handler_.reserve(new_archetype,
+                                       new_archetype->entities.size() + 1);
         }
+        migrate_to(entity, new_archetype,
+                   [](component_id_t) -> std::byte* { return nullptr; });
     }
 
     template <typename... Cs>
     inline auto registry::get(chunk_id_t chunk_id) {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components are only handed out by for_each "
+                      "and get_entity_components");
+        archetype_map_.for_each_matching(
+            archetype_key{get_signature<Cs...>(), chunk_id},
+            [&](archetype* arch) {
+                archetype_handler_.mark_written<Cs&...>(
+                    arch, 0, arch->entities.size());
+            });
         return archetype_map_view<Cs...>{&archetype_map_,
                                          get_signature<Cs...>(), chunk_id};
     }
 
+    template <typename... Cs, query_filter... Filters>
+    requires(sizeof...(Filters) > 0) inline auto registry::get(
+        chunk_id_t chunk_id, const Filters&... filters) {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components are only handed out by for_each "
+                      "and get_entity_components");
+        static_assert(!(block_filter<Filters> || ...),
+                      "views can't skip blocks, filter changes with for_each "
+                      "or for_each_span");
+        using view_type =
+            typename filtered_view<archetype_map_view<Cs...>, Filters...>::type;
+        query_mask mask{get_signature<Cs...>()};
+        (filters.restrict(mask), ...);
+        archetype_map_.for_each_matching(
+            archetype_key{mask.include, chunk_id}, [&](archetype* arch) {
+                if (mask.accepts(arch->key.signature)) {
+                    view_type::mark_written(archetype_handler_, arch);
+                }
+            });
+        return view_type{&archetype_map_, std::move(mask), chunk_id};
+    }
+
+    template <typename... Cs>
+    ant::query<Cs...> registry::query(chunk_id_t chunk_id) {
+        static_assert(!any_sparse_v<Cs...>,
+                      "sparse components are only handed out by for_each "
+                      "and get_entity_components");
+        return ant::query<Cs...>{
+            archetype_map_.register_query(
+                archetype_key{get_signature<Cs...>(), chunk_id}),
+            &archetype_handler_};
+    }
+
     template <typename... Cs>
     std::tuple<Cs&...> registry::get_entity_components(entity_t entity) {
-        return archetype_handler_.get_components<Cs...>(
-            entity_index_->at(entity).entity_archetype,
-            entity_index_->at(entity).index);
+        const record_t& record = entity_index_->at(entity);
+        if constexpr (any_sparse_v<Cs...>) {
+            return std::tuple<Cs&...>(entity_component<Cs>(entity, record)...);
+        } else {
+            archetype_handler_.mark_written<Cs&...>(
+                record.entity_archetype, record.index, record.index + 1);
+            return archetype_handler_.get_components<Cs...>(
+                record.entity_archetype, record.index);
+        }
     }
 
     template <typename F>
     void registry::for_each(F&& f, chunk_id_t chunk_id) {
         typename functor_traits<F>::args_type types;
+        if constexpr (sparse_arguments_v<decltype(types)>) {
+            for_each_joined(f, types, chunk_id);
+            return;
+        }
 
         archetype_key include{get_signature(types), chunk_id};
-        for (const auto& key : archetype_map_.get_keys()) {
-            if (key.match(include)) {
-                archetype_handler_.apply(std::forward<F>(f), types,
-                                         archetype_map_.get(key));
+        archetype_map_.for_each_matching(include, [&](archetype* arch) {
+            archetype_handler_.apply(std::forward<F>(f), types, arch);
+        });
+    }
+
+    template <typename F, query_filter... Filters>
+    requires(sizeof...(Filters) > 0) void registry::for_each(
+        F&& f, chunk_id_t chunk_id, const Filters&... filters) {
+        typename functor_traits<F>::args_type types;
+        if constexpr (sparse_arguments_v<decltype(types)>) {
+            for_each_joined(f, types, chunk_id, filters...);
+        } else {
+            query_mask mask{get_signature(types)};
+            (filters.restrict(mask), ...);
+            archetype_map_.for_each_matching(
+                archetype_key{mask.include, chunk_id}, [&](archetype* arch) {
+                    if (!mask.accepts(arch->key.signature)) {
+                        return;
+                    }
+                    if constexpr ((block_filter<Filters> || ...)) {
+                        archetype_handler_.apply_filtered(f, types, arch,
+                                                          filters...);
+                    } else {
+                        archetype_handler_.apply(f, types, arch);
+                    }
+                });
+        }
+    }
+
+    template <typename F, typename Entity_T, typename... Args,
+              typename... Filters>
+    void registry::for_each_joined(F& f, type_list<Entity_T, Args...> types,
+                                   chunk_id_t chunk_id,
+                                   const Filters&... filters) {
+        static_assert((!is_soa_ref_v<std::remove_cvref_t<Args>> && ...),
+                      "soa components can't be joined with sparse ones");
+        query_mask mask{get_signature(types)};
+        (filters.restrict(mask), ...);
+
+        // the sets of the sparse arguments, the smallest of the ones taken
+        // by reference drives the iteration
+        std::array<sparse_set_base*, sizeof...(Args)> sets{};
+        sparse_set_base* driver = nullptr;
+        bool missing = false;
+        size_t i = 0;
+        (
+            [&]<typename A>() {
+                using arg = std::remove_reference_t<A>;
+                using component = std::remove_cv_t<std::remove_pointer_t<arg>>;
+                sparse_set_base*& set = sets[i++];
+                if constexpr (sparse_component<component>) {
+                    set = find_sparse(type_id_generator::get<component>());
+                    if constexpr (!std::is_pointer_v<arg>) {
+                        if (!set) {
+                            missing = true;
+                        } else if (!driver || set->size() < driver->size()) {
+                            driver = set;
+                        }
+                    }
+                }
+            }.template operator()<Args>(),
+            ...);
+        if (missing) {
+            return;
+        }
+
+        auto visit = [&](entity_t entity, archetype* arch, size_t row) {
+            if constexpr ((block_filter<Filters> || ...)) {
+                if (!(([&] {
+                         if constexpr (block_filter<Filters>) {
+                             return filters.accepts(*arch,
+                                                    row >> arch->block_shift);
+                         } else {
+                             return true;
+                         }
+                     }())
+                      && ...)) {
+                    return;
+                }
+            }
+            const std::tuple arguments
+                = [&]<size_t... Is>(std::index_sequence<Is...>) {
+                      return std::tuple{
+                          find_argument<Args>(sets[Is], entity, arch, row)...};
+                  }(std::index_sequence_for<Args...>{});
+            const bool complete = std::apply(
+                [](auto*... pointers) {
+                    return ((std::is_pointer_v<std::remove_reference_t<Args>>
+                             || pointers != nullptr)
+                            && ...);
+                },
+                arguments);
+            if (!complete) {
+                return;
+            }
+            if (arch) {
+                archetype_handler_.mark_written<Args...>(arch, row, row + 1);
+            }
+            std::apply(
+                [&](auto*... pointers) {
+                    f(entity, [&]() -> Args {
+                        if constexpr (std::is_pointer_v<
+                                          std::remove_reference_t<Args>>) {
+                            return pointers;
+                        } else {
+                            return *pointers;
+                        }
+                    }()...);
+                },
+                arguments);
+        };
+
+        if (driver) {
+            const signature_t none;
+            for (entity_t entity : driver->entities()) {
+                const record_t& record = (*entity_index_)[entity];
+                archetype* arch = record.entity_archetype;
+                const signature_t& signature
+                    = arch ? arch->key.signature : none;
+                if (record.chunk_id == chunk_id
+                    && signature.contains(mask.include)
+                    && mask.accepts(signature)) {
+                    visit(entity, arch, record.index);
+                }
+            }
+        } else {
+            archetype_map_.for_each_matching(
+                archetype_key{mask.include, chunk_id}, [&](archetype* arch) {
+                    if (!mask.accepts(arch->key.signature)) {
+                        return;
+                    }
+                    for (size_t row = 0; row < arch->entities.size(); row++) {
+                        visit(arch->entities[row], arch, row);
+                    }
+                });
+        }
+    }
+
+    template <typename A>
+    auto* registry::find_argument(sparse_set_base* set, entity_t entity,
+                                  archetype* arch, size_t row) {
+        using component = std::remove_pointer_t<std::remove_reference_t<A>>;
+        using bare = std::remove_cv_t<component>;
+        const component_id_t component_id = type_id_generator::get<bare>();
+        component* found = nullptr;
+        if constexpr (sparse_component<bare>) {
+            if (set) {
+                found = static_cast<sparse_set<bare>*>(set)->find(entity);
+            }
+        } else if constexpr (is_tag_v<bare>) {
+            if (arch && arch->key.signature.test(component_id)) {
+                found = &tag_instance<bare>();
+            }
+        } else if (arch) {
+            const size_t column = arch->find_column(component_id);
+            if (column != _no_column) {
+                found = std::launder(reinterpret_cast<bare*>(
+                    arch->get_data(column, row, sizeof(bare))));
+            }
+        }
+        return found;
+    }
+
+    template <typename F, query_filter... Filters>
+    void registry::for_each_span(F&& f, chunk_id_t chunk_id,
+                                 const Filters&... filters) {
+        typename functor_traits<F>::args_type types;
+
+        query_mask mask{span_signature(types)};
+        (filters.restrict(mask), ...);
+        archetype_map_.for_each_matching(
+            archetype_key{mask.include, chunk_id}, [&](archetype* arch) {
+                if (mask.accepts(arch->key.signature)) {
+                    archetype_handler_.apply_spans(f, types, arch, filters...);
+                }
+            });
+    }
+
+    inline void registry::apply(command_buffer& buffer) {
+        using command_type = command_buffer::command_type;
+        using command = command_buffer::command;
+        check_structural_change();
+        for (component_id_t component_id = 0;
+             component_id < buffer.components_.size(); component_id++) {
+            const auto& entry = buffer.components_[component_id];
+            if (entry.make_sparse) {
+                if (!find_sparse(component_id)) {
+                    register_sparse(component_id, entry.make_sparse());
+                }
+            } else if (entry.component
+                       && !component_map_->contains(component_id)) {
+                register_component(component_id, entry.make(),
+                                   entry.type->name());
+            }
+        }
+
+        // commands of each entity chained in recording order, entities are
+        // found back through command_slots_ indexed by entity index
+        struct pending {
+            entity_t entity;
+            uint32_t first_command;
+            uint32_t last_command;
+        };
+        constexpr uint32_t npos = UINT32_MAX;
+        std::vector<pending> pendings;
+        pendings.reserve(buffer.commands_.size());
+        std::vector<uint32_t> next_command(buffer.commands_.size(), npos);
+        std::vector<entity_t> created;
+        created.reserve(buffer.create_count_);
+        for (uint32_t i = 0; i < buffer.commands_.size(); i++) {
+            command& command = buffer.commands_[i];
+            if (command.type == command_type::create) {
+                created.push_back(entity_index_->create(command.chunk_id));
+                continue;
+            }
+            if (is_placeholder(command.entity)) {
+                command.entity = created.at(get_entity_index(command.entity) - 1);
+            }
+            if (!entity_index_->contains(command.entity)) {
+                continue;
+            }
+            const index_t index = get_entity_index(command.entity);
+            if (index >= command_slots_.size()) {
+                command_slots_.resize(entity_index_->extent(), npos);
+            }
+            uint32_t& slot = command_slots_[index];
+            if (slot == npos) {
+                slot = static_cast<uint32_t>(pendings.size());
+                pendings.push_back(pending{command.entity, i, i});
+            } else {
+                next_command[pendings[slot].last_command] = i;
+                pendings[slot].last_command = i;
+            }
+        }
+        for (const auto& entity : pendings) {
+            command_slots_[get_entity_index(entity.entity)] = npos;
+        }
+
+        struct migration {
+            entity_t entity;
+            size_t row;
+            // values of the entity in new_values
+            size_t first_value;
+            size_t last_value;
+        };
+        struct migration_group {
+            archetype* from;
+            archetype* to;
+            std::vector<migration> migrations{};
+        };
+        std::vector<migration_group> groups;
+        std::map<std::pair<archetype*, archetype*>, size_t> group_index;
+        size_t last_group = 0;
+        std::vector<entity_t> destroyed;
+        // played once the entities reached their archetype
+        std::vector<command*> sparse_commands;
+        std::vector<command*> new_values;
+        new_values.reserve(buffer.commands_.size());
+
+        for (const auto& entity : pendings) {
+            const record_t& record = (*entity_index_)[entity.entity];
+            archetype* from = record.entity_archetype;
+            const signature_t current
+                = from ? from->key.signature : signature_t{};
+            signature_t target = current;
+            const size_t first_value = new_values.size();
+            auto forget_value = [&](component_id_t component_id) {
+                auto value = std::find_if(
+                    new_values.begin() + first_value, new_values.end(),
+                    [&](const command* c) {
+                        return c->component_id == component_id;
+                    });
+                if (value != new_values.end()) {
+                    new_values.erase(value);
+                }
+            };
+            bool destroy = false;
+            for (uint32_t i = entity.first_command; i != npos && !destroy;
+                 i = next_command[i]) {
+                command& command = buffer.commands_[i];
+                if (command.type != command_type::destroy
+                    && find_sparse(command.component_id)) {
+                    sparse_commands.push_back(&command);
+                    continue;
+                }
+                switch (command.type) {
+                    case command_type::destroy:
+                        destroy = true;
+                        break;
+                    case command_type::add:
+                        forget_value(command.component_id);
+                        new_values.push_back(&command);
+                        target.set(command.component_id);
+                        break;
+                    case command_type::remove:
+                        forget_value(command.component_id);
+                        target.reset(command.component_id);
+                        break;
+                    default:
+                        break;
+                }
+            }
+            if (destroy) {
+                new_values.resize(first_value);
+                destroyed.push_back(entity.entity);
+                continue;
+            }
+            if (target == current && new_values.size() == first_value) {
+                continue;
+            }
+
+            // consecutive entities mostly share their migration
+            archetype* to = nullptr;
+            if (!target.none()) {
+                const archetype_key key{target, record.chunk_id};
+                to = !groups.empty() && groups[last_group].to
+                             && groups[last_group].to->key == key
+                         ? groups[last_group].to
+                         : archetype_map_.get(key);
+            }
+            if (groups.empty() || groups[last_group].from != from
+                || groups[last_group].to != to) {
+                auto [it, inserted]
+                    = group_index.try_emplace({from, to}, groups.size());
+                if (inserted) {
+                    groups.push_back(migration_group{from, to});
+                }
+                last_group = it->second;
+            }
+            groups[last_group].migrations.push_back(
+                migration{entity.entity, 0, first_value, new_values.size()});
+        }
+
+        destroy(destroyed);
+
+        for (auto& [from, to, migrations] : groups) {
+            // leaving from the last rows first, the entities filling the
+            // holes are then mostly the ones that leave next
+            for (auto& m : migrations) {
+                m.row = (*entity_index_)[m.entity].index;
+            }
+            auto by_row = [](const migration& a, const migration& b) {
+                return a.row < b.row;
+            };
+            if (std::is_sorted(migrations.begin(), migrations.end(), by_row)) {
+                std::reverse(migrations.begin(), migrations.end());
+            } else {
+                std::sort(migrations.rbegin(), migrations.rend(), by_row);
+            }
+
+            // components left and entered, observers are notified
+            // before the entities leave from and once they are in to
+            signature_t removed;
+            signature_t added;
+            std::vector<entity_t> group_entities;
+            if (to != from) {
+                removed = from ? from->key.signature : signature_t{};
+                added = to ? to->key.signature : signature_t{};
+                removed.subtract(added);
+                added.subtract(from ? from->key.signature : signature_t{});
+                if (removed.intersects(
+                        observers_.observed(observer_event::remove))
+                    || added.intersects(
+                        observers_.observed(observer_event::add))) {
+                    for (const auto& m : migrations) {
+                        group_entities.push_back(m.entity);
+                    }
+                }
+                notify_each(observer_event::remove, removed, from,
+                            group_entities);
+            }
+
+            if (to && to != from) {
+                archetype_handler_.reserve(
+                    to, to->entities.size() + migrations.size());
+            }
+            const auto plan = archetype_handler_.plan_migration(from, to);
+            for (const auto& m : migrations) {
+                record_t& record = (*entity_index_)[m.entity];
+                if (to == from) {
+                    // only replaced values, the entity stays in place
+                    for (size_t v = m.first_value; v < m.last_value; v++) {
+                        command* command = new_values[v];
+                        component_base* component
+                            = buffer.component(command->component_id);
+                        if (component->is_tag()) {
+                            continue;
+                        }
+                        const size_t size = component->get_size();
+                        std::byte* data = to->get_data(
+                            to->column(command->component_id),
+                            record.index, size);
+                        component->destroy_data(data);
+                        component->relocate_n(
+                            std::exchange(command->value, nullptr), data, 1);
+                        archetype_handler_.mark_written(
+                            to, to->column(command->component_id),
+                            record.index, record.index + 1);
+                    }
+                    continue;
+                }
+                archetype_handler_.migrate_entity(
+                    plan, record.index,
+                    [&](component_id_t component_id) -> std::byte* {
+                        for (size_t v = m.first_value; v < m.last_value; v++) {
+                            if (new_values[v]->component_id == component_id) {
+                                return std::exchange(new_values[v]->value,
+                                                     nullptr);
+                            }
+                        }
+                        return nullptr;
+                    });
+                if (to) {
+                    archetype_handler_.move_entity_to_archetype(to, m.entity);
+                } else {
+                    record.entity_archetype = nullptr;
+                    record.index = 0;
+                }
+            }
+            if (from && from != to) {
+                archetype_handler_.shrink(from);
+            }
+            notify_each(observer_event::add, added, to, group_entities);
+        }
+
+        for (command* command : sparse_commands) {
+            const entity_t entity = command->entity;
+            if (!entity_index_->contains(entity)) {
+                continue;
+            }
+            sparse_set_base& set = *sparse_sets_[command->component_id];
+            const bool present = set.contains(entity);
+            const archetype* arch = (*entity_index_)[entity].entity_archetype;
+            if (command->type == command_type::add) {
+                set.relocate(entity, std::exchange(command->value, nullptr));
+                if (!present) {
+                    notify(observer_event::add, command->component_id, arch,
+                           {&entity, 1});
+                }
+            } else if (present) {
+                notify(observer_event::remove, command->component_id, arch,
+                       {&entity, 1});
+                set.erase(entity);
+            }
+        }
+        buffer.clear();
+    }
+
+    template <typename F>
+    void registry::par_for_each(F&& f, chunk_id_t chunk_id) {
+        typename functor_traits<F>::args_type types;
+        static_assert(!sparse_arguments_v<decltype(types)>,
+                      "par_for_each can't take sparse components");
+
+        archetype_key include{get_signature(types), chunk_id};
+        // nested in a scheduler system or another par_for_each task, the
+        // pool can't be waited on from its own workers
+        const structure_lock lock(parallel_iterations_);
+        thread_pool* pool = worker_count_ > 1 && !lock.nested()
+                                ? &get_thread_pool()
+                                : nullptr;
+        try {
+            archetype_map_.for_each_matching(include, [&](archetype* arch) {
+                const size_t size = arch->entities.size();
+                // marked up front, tasks share the blocks of contiguous
+                // archetypes
+                archetype_handler_.mark_written(types, arch, 0, size);
+                if (pool == nullptr) {
+                    archetype_handler_.apply_range(f, types, arch, 0, size);
+                    return;
+                }
+                const size_t grain = arch->policy == storage_policy::chunked
+                                         ? arch->block_capacity()
+                                         : _parallel_grain;
+                for (size_t first = 0; first < size; first += grain) {
+                    const size_t last = std::min(first + grain, size);
+                    pool->submit([&, arch, first, last] {
+                        archetype_handler_.apply_range(f, types, arch, first,
+                                                       last);
+                    });
+                }
+            });
+            if (pool != nullptr) {
+                pool->wait();
+            }
+        } catch (...) {
+            // the submitted tasks reference f, they have to be done before
+            // unwinding. wait may rethrow one of their exceptions instead,
+            // the lock is released either way
+            if (pool != nullptr) {
+                pool->wait();
             }
+            throw;
         }
     }
 }  // namespace ant
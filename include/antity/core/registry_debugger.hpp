@@ -10,8 +10,13 @@ namespace ant {
        public:
         template <typename C>
         void on_component_registration() {
-            componentNameMap.emplace(type_id_generator::get<C>(),
-                                     typeid(C).name());
+            on_component_registration(type_id_generator::get<C>(),
+                                      typeid(C).name());
+        }
+
+        void on_component_registration(component_id_t component_id,
+                                       const char* name) {
+            componentNameMap.emplace(component_id, name);
         }
 
        private:
@@ -0,0 +1,223 @@
+#pragma once
+#include <antity/core/archetype.hpp>
+#include <antity/core/filter.hpp>
+#include <antity/core/identifier.hpp>
+#include <antity/core/registry.hpp>
+#include <antity/core/soa.hpp>
+#include <antity/utility/function_traits.hpp>
+#include <antity/utility/thread_pool.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ant {
+
+    namespace details {
+        template <typename T>
+        inline constexpr bool is_std_span_v = false;
+
+        template <typename T, size_t Extent>
+        inline constexpr bool is_std_span_v<std::span<T, Extent>> = true;
+
+        /**
+         * @brief adds the components accessed through a parameter of a
+         *        system to reads or writes: const references, const
+         *        pointers, values and spans or soa proxies of const
+         *        components are reads
+         */
+        template <typename P>
+        void add_access(signature_t& reads, signature_t& writes) {
+            using arg = std::remove_reference_t<P>;
+            using bare = std::remove_const_t<arg>;
+            if constexpr (is_std_span_v<bare> || is_soa_ref_v<bare>
+                          || is_soa_span_v<bare>) {
+                using element = typename bare::element_type;
+                (std::is_const_v<element> ? reads : writes)
+                    |= get_signature<std::remove_const_t<element>>();
+            } else {
+                using component = std::remove_pointer_t<arg>;
+                const bool read = std::is_const_v<component>
+                                  || (!std::is_reference_v<P>
+                                      && !std::is_pointer_v<arg>);
+                (read ? reads : writes)
+                    |= get_signature<std::remove_const_t<component>>();
+            }
+        }
+
+        template <typename First, typename... Ps>
+        void add_accesses(type_list<First, Ps...>, signature_t& reads,
+                          signature_t& writes) {
+            (add_access<Ps>(reads, writes), ...);
+        }
+    }  // namespace details
+
+    /**
+     * @brief runs a set of systems once per call to run, concurrently on
+     *        the thread pool of the registry when they don't conflict
+     *
+     *        a system is a for_each callable, f(entity_t, Cs...), or a
+     *        for_each_span one, f(std::span<const entity_t>, spans...).
+     *        the components it reads and writes are taken from its
+     *        parameters, const ones are read. two systems iterating the
+     *        same chunk conflict when either writes a component the other
+     *        accesses, conflicting systems run in the order they were
+     *        added, the others in any order
+     */
+    class scheduler {
+       public:
+        explicit scheduler(registry& registry) : registry_(&registry) {}
+
+        scheduler(const scheduler&) = delete;
+        scheduler& operator=(const scheduler&) = delete;
+
+        /**
+         * @brief appends a system, it runs after the systems added before
+         *        it conflicts with
+         * \param filters as for registry::for_each, the components of
+         * changed and added filters count as read
+         */
+        template <typename F, query_filter... Filters>
+        scheduler& add(F&& f, chunk_id_t chunk_id, const Filters&... filters);
+
+        template <typename F, query_filter... Filters>
+        scheduler& add(F&& f, const Filters&... filters) {
+            return add(std::forward<F>(f), _null_chunk, filters...);
+        }
+
+        /**
+         * @brief runs every system once. creating, destroying, adding or
+         *        removing components meanwhile throws std::logic_error,
+         *        record them in a concurrent_command_buffer instead. the
+         *        first exception thrown by a system is rethrown once the
+         *        running ones are done, the systems depending on it are
+         *        skipped
+         */
+        void run();
+
+        [[nodiscard]] size_t size() const noexcept { return systems_.size(); }
+
+        /**
+         * @brief indices of the systems the system-th one waits for, in
+         *        increasing order
+         */
+        [[nodiscard]] const std::vector<size_t>& dependencies(
+            size_t system) const {
+            return systems_.at(system).dependencies;
+        }
+
+       private:
+        struct system {
+            std::function<void()> run{};
+            chunk_id_t chunk_id{_null_chunk};
+            signature_t reads{};
+            signature_t writes{};
+            std::vector<size_t> dependencies{};
+            std::vector<size_t> dependents{};
+        };
+
+        [[nodiscard]] static bool conflicts(const system& lhs,
+                                            const system& rhs) noexcept {
+            return lhs.chunk_id == rhs.chunk_id
+                   && (lhs.writes.intersects(rhs.writes)
+                       || lhs.writes.intersects(rhs.reads)
+                       || rhs.writes.intersects(lhs.reads));
+        }
+
+        void submit(thread_pool& pool, size_t index) {
+            pool.submit([this, &pool, index] {
+                systems_[index].run();
+                for (size_t dependent : systems_[index].dependents) {
+                    if (remaining_[dependent].fetch_sub(
+                            1, std::memory_order_acq_rel)
+                        == 1) {
+                        submit(pool, dependent);
+                    }
+                }
+            });
+        }
+
+        registry* registry_;
+        std::vector<system> systems_;
+        // dependencies of each system left to run in the current run
+        std::unique_ptr<std::atomic<size_t>[]> remaining_;
+    };
+
+    template <typename F, query_filter... Filters>
+    scheduler& scheduler::add(F&& f, chunk_id_t chunk_id,
+                              const Filters&... filters) {
+        using args_type = typename functor_traits<F>::args_type;
+        constexpr bool spans = []<typename First, typename... Ps>(
+                                   type_list<First, Ps...>) {
+            return details::is_std_span_v<std::remove_cvref_t<First>>;
+        }(args_type{});
+
+        system added{.chunk_id = chunk_id};
+        // ids are generated here, on the calling thread
+        details::add_accesses(args_type{}, added.reads, added.writes);
+        query_mask mask;
+        (filters.restrict(mask), ...);
+        added.reads |= mask.include;
+        added.run = [registry = registry_, f = std::forward<F>(f), chunk_id,
+                     filters = std::tuple{filters...}]() mutable {
+            std::apply(
+                [&](const Filters&... filters) {
+                    if constexpr (spans) {
+                        registry->for_each_span(f, chunk_id, filters...);
+                    } else {
+                        registry->for_each(f, chunk_id, filters...);
+                    }
+                },
+                filters);
+        };
+
+        const size_t index = systems_.size();
+        for (size_t i = 0; i < index; ++i) {
+            if (conflicts(systems_[i], added)) {
+                systems_[i].dependents.push_back(index);
+                added.dependencies.push_back(i);
+            }
+        }
+        systems_.push_back(std::move(added));
+        remaining_ = std::make_unique<std::atomic<size_t>[]>(systems_.size());
+        return *this;
+    }
+
+    inline void scheduler::run() {
+        const registry::structure_lock lock(registry_->parallel_iterations_);
+        thread_pool* pool = registry_->worker_count_ > 1
+                                ? &registry_->get_thread_pool()
+                                : nullptr;
+        try {
+            if (pool == nullptr) {
+                for (system& system : systems_) {
+                    system.run();
+                }
+            } else {
+                for (size_t i = 0; i < systems_.size(); ++i) {
+                    remaining_[i].store(systems_[i].dependencies.size(),
+                                        std::memory_order_relaxed);
+                }
+                for (size_t i = 0; i < systems_.size(); ++i) {
+                    if (systems_[i].dependencies.empty()) {
+                        submit(*pool, i);
+                    }
+                }
+                pool->wait();
+            }
+        } catch (...) {
+            // systems still running reference this scheduler, wait may
+            // rethrow one of their exceptions, the lock is released anyway
+            if (pool != nullptr) {
+                pool->wait();
+            }
+            throw;
+        }
+    }
+
+}  // namespace ant
@@ -0,0 +1,282 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace ant {
+
+    /**
+     * @brief set of component ids of unbounded size. bits are stored in 64
+     *        bit words, the first _inline_words inline and the others in an
+     *        overflow array, so small signatures never chase a pointer.
+     *        trailing zero words are trimmed and words past size are zero so
+     *        that equality, hashing and none only look at the words in use
+     */
+    class signature {
+       public:
+        using word_type = uint64_t;
+        static constexpr size_t _word_bits = 64;
+        static constexpr size_t _inline_words = 2;
+
+        signature() noexcept = default;
+
+        signature(const signature& other) { assign(other); }
+
+        signature(signature&& other) noexcept
+            : inline_{std::exchange(other.inline_[0], 0),
+                      std::exchange(other.inline_[1], 0)},
+              overflow_(std::move(other.overflow_)),
+              capacity_(std::exchange(other.capacity_, _inline_words)),
+              size_(std::exchange(other.size_, 0)) {}
+
+        signature& operator=(const signature& other) {
+            if (this != &other) {
+                assign(other);
+            }
+            return *this;
+        }
+
+        signature& operator=(signature&& other) noexcept {
+            if (this != &other) {
+                inline_[0] = std::exchange(other.inline_[0], 0);
+                inline_[1] = std::exchange(other.inline_[1], 0);
+                overflow_ = std::move(other.overflow_);
+                capacity_ = std::exchange(other.capacity_, _inline_words);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        [[nodiscard]] bool test(size_t bit) const noexcept {
+            const size_t word = bit / _word_bits;
+            return word < size_
+                   && (get_word(word) >> (bit % _word_bits)) & word_type{1};
+        }
+
+        [[nodiscard]] bool operator[](size_t bit) const noexcept {
+            return test(bit);
+        }
+
+        signature& set(size_t bit) {
+            const size_t word = bit / _word_bits;
+            if (word >= capacity_) {
+                grow(word + 1);
+            }
+            word_at(word) |= word_type{1} << (bit % _word_bits);
+            size_ = std::max(size_, static_cast<uint32_t>(word + 1));
+            return *this;
+        }
+
+        signature& reset(size_t bit) noexcept {
+            const size_t word = bit / _word_bits;
+            if (word < size_) {
+                word_at(word) &= ~(word_type{1} << (bit % _word_bits));
+                trim();
+            }
+            return *this;
+        }
+
+        [[nodiscard]] bool none() const noexcept { return size_ == 0; }
+        [[nodiscard]] bool any() const noexcept { return size_ != 0; }
+
+        [[nodiscard]] size_t count() const noexcept {
+            size_t count = std::popcount(inline_[0]) + std::popcount(inline_[1]);
+            for (size_t i = _inline_words; i < size_; ++i) {
+                count += std::popcount(get_word(i));
+            }
+            return count;
+        }
+
+        /**
+         * @brief one past the highest bit that may be set
+         */
+        [[nodiscard]] size_t size() const noexcept {
+            return size_ * _word_bits;
+        }
+
+        /**
+         * @brief whether every bit of other is set in this
+         */
+        [[nodiscard]] bool contains(const signature& other) const noexcept {
+            if ((other.inline_[0] & ~inline_[0])
+                | (other.inline_[1] & ~inline_[1])) {
+                return false;
+            }
+            if (other.size_ <= _inline_words) {
+                return true;
+            }
+            if (other.size_ > size_) {
+                return false;
+            }
+            for (size_t i = _inline_words; i < other.size_; ++i) {
+                if (other.get_word(i) & ~get_word(i)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * @brief whether this and other share at least a bit
+         */
+        [[nodiscard]] bool intersects(const signature& other) const noexcept {
+            if ((inline_[0] & other.inline_[0])
+                | (inline_[1] & other.inline_[1])) {
+                return true;
+            }
+            const size_t size = std::min(size_, other.size_);
+            for (size_t i = _inline_words; i < size; ++i) {
+                if (get_word(i) & other.get_word(i)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        signature& operator|=(const signature& other) {
+            if (other.size_ > capacity_) {
+                grow(other.size_);
+            }
+            for (size_t i = 0; i < other.size_; ++i) {
+                word_at(i) |= other.get_word(i);
+            }
+            size_ = std::max(size_, other.size_);
+            return *this;
+        }
+
+        signature& operator&=(const signature& other) noexcept {
+            for (size_t i = 0; i < size_; ++i) {
+                word_at(i) &= i < other.size_ ? other.get_word(i) : 0;
+            }
+            trim();
+            return *this;
+        }
+
+        /**
+         * @brief clears the bits set in other
+         */
+        signature& subtract(const signature& other) noexcept {
+            const size_t size = std::min(size_, other.size_);
+            for (size_t i = 0; i < size; ++i) {
+                word_at(i) &= ~other.get_word(i);
+            }
+            trim();
+            return *this;
+        }
+
+        [[nodiscard]] friend signature operator|(signature lhs,
+                                                 const signature& rhs) {
+            return lhs |= rhs;
+        }
+
+        [[nodiscard]] friend signature operator&(signature lhs,
+                                                 const signature& rhs) {
+            return lhs &= rhs;
+        }
+
+        [[nodiscard]] bool operator==(const signature& other) const noexcept {
+            if (size_ != other.size_ || inline_[0] != other.inline_[0]
+                || inline_[1] != other.inline_[1]) {
+                return false;
+            }
+            return size_ <= _inline_words
+                   || std::equal(overflow_.get(),
+                                 overflow_.get() + (size_ - _inline_words),
+                                 other.overflow_.get());
+        }
+
+        [[nodiscard]] bool operator!=(const signature& other) const noexcept {
+            return !(*this == other);
+        }
+
+        /**
+         * @brief calls f(size_t bit) on every set bit in increasing order
+         */
+        template <typename F>
+        void for_each(F&& f) const {
+            for (size_t i = 0; i < size_; ++i) {
+                for (word_type word = get_word(i); word != 0;
+                     word &= word - 1) {
+                    f(i * _word_bits + std::countr_zero(word));
+                }
+            }
+        }
+
+        [[nodiscard]] size_t hash() const noexcept {
+            // fibonacci hashing, one multiplication per word in use
+            size_t h = size_;
+            for (size_t i = 0; i < size_; ++i) {
+                h = (std::rotl(h, 21) ^ get_word(i)) * 0x9E3779B97F4A7C15ull;
+            }
+            return h ^ (h >> 32);
+        }
+
+        /**
+         * @brief i-th word, i must be lower than size() / _word_bits
+         */
+        [[nodiscard]] word_type get_word(size_t i) const noexcept {
+            return i < _inline_words ? inline_[i]
+                                     : overflow_[i - _inline_words];
+        }
+
+       private:
+        word_type& word_at(size_t i) noexcept {
+            return i < _inline_words ? inline_[i]
+                                     : overflow_[i - _inline_words];
+        }
+
+        [[gnu::noinline]] void grow(size_t words_count) {
+            const size_t capacity
+                = std::max<size_t>(words_count, capacity_ * 2);
+            auto overflow
+                = std::make_unique<word_type[]>(capacity - _inline_words);
+            if (size_ > _inline_words) {
+                std::copy_n(overflow_.get(), size_ - _inline_words,
+                            overflow.get());
+            }
+            overflow_ = std::move(overflow);
+            capacity_ = static_cast<uint32_t>(capacity);
+        }
+
+        void trim() noexcept {
+            while (size_ > 0 && get_word(size_ - 1) == 0) {
+                --size_;
+            }
+        }
+
+        void assign(const signature& other) {
+            inline_[0] = other.inline_[0];
+            inline_[1] = other.inline_[1];
+            if (size_ > _inline_words) {
+                std::fill_n(overflow_.get(), size_ - _inline_words, 0);
+            }
+            if (other.size_ > capacity_) {
+                grow(other.size_);
+            }
+            if (other.size_ > _inline_words) {
+                std::copy_n(other.overflow_.get(),
+                            other.size_ - _inline_words, overflow_.get());
+            }
+            size_ = other.size_;
+        }
+
+        word_type inline_[_inline_words] = {};
+        std::unique_ptr<word_type[]> overflow_;
+        // words allocated, inline ones included
+        uint32_t capacity_ = _inline_words;
+        // words in use, the last one is never zero
+        uint32_t size_ = 0;
+    };
+
+}  // namespace ant
+
+template <>
+struct std::hash<ant::signature> {
+    size_t operator()(const ant::signature& signature) const noexcept {
+        return signature.hash();
+    }
+};
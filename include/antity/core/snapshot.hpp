@@ -0,0 +1,100 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace ant {
+
+    /**
+     * @brief specialize it to snapshot a component that isn't trivially
+     *        copyable, trivially copyable ones are dumped byte for byte
+     *
+     *        static void write(std::ostream& out, const C* components,
+     *                          size_t count);
+     *        // constructs count components in uninitialized storage, either
+     *        // all of them or none when it throws
+     *        static void read(std::istream& in, C* storage, size_t count);
+     */
+    template <typename C>
+    struct component_serializer;
+
+    template <typename C>
+    concept custom_serializable = requires(std::ostream& out, std::istream& in,
+                                           const C* components, C* storage,
+                                           size_t count) {
+        component_serializer<C>::write(out, components, count);
+        component_serializer<C>::read(in, storage, count);
+    };
+
+    template <typename C>
+    concept serializable_component
+        = custom_serializable<C> || std::is_trivially_copyable_v<C>;
+
+    /**
+     * @brief native endian binary io of the snapshots, stream errors are
+     *        turned into exceptions
+     */
+    namespace binary {
+        inline void write_bytes(std::ostream& out, const void* data,
+                                size_t size) {
+            out.write(static_cast<const char*>(data),
+                      static_cast<std::streamsize>(size));
+            if (!out) {
+                throw std::runtime_error("snapshot write failed");
+            }
+        }
+
+        inline void read_bytes(std::istream& in, void* data, size_t size) {
+            in.read(static_cast<char*>(data),
+                    static_cast<std::streamsize>(size));
+            if (static_cast<size_t>(in.gcount()) != size) {
+                throw std::runtime_error("truncated snapshot");
+            }
+        }
+
+        template <typename T>
+        requires(std::is_trivially_copyable_v<T>) void write(std::ostream& out,
+                                                             const T& value) {
+            write_bytes(out, &value, sizeof(T));
+        }
+
+        template <typename T>
+        requires(std::is_trivially_copyable_v<T>) T read(std::istream& in) {
+            T value;
+            read_bytes(in, &value, sizeof(T));
+            return value;
+        }
+
+        inline void write_string(std::ostream& out, const std::string& value) {
+            write(out, static_cast<uint32_t>(value.size()));
+            write_bytes(out, value.data(), value.size());
+        }
+
+        inline std::string read_string(std::istream& in) {
+            std::string value(read<uint32_t>(in), '\0');
+            read_bytes(in, value.data(), value.size());
+            return value;
+        }
+    }  // namespace binary
+
+    /**
+     * @brief first bytes of every snapshot, followed by _snapshot_version
+     */
+    inline constexpr uint64_t _snapshot_magic = 0x50414e5359544e41;  // ANTYSNAP
+    inline constexpr uint32_t _snapshot_version = 1;
+    /**
+     * @brief first bytes of the files of registry::snapshot_mapped
+     */
+    inline constexpr uint64_t _mapped_snapshot_magic
+        = 0x50414d5359544e41;  // ANTYSMAP
+    /**
+     * @brief first bytes of the output of registry::snapshot_delta
+     */
+    inline constexpr uint64_t _delta_snapshot_magic
+        = 0x41544c4459544e41;  // ANTYDLTA
+
+}  // namespace ant
@@ -0,0 +1,229 @@
+#pragma once
+#include <antity/core/identifier.hpp>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace ant {
+
+    /**
+     * @brief specialize it to store each field of C in a column of its
+     *        own, so that kernels stream x, y... separately
+     *
+     *        template <>
+     *        struct ant::soa_layout<position> {
+     *            static constexpr auto fields
+     *                = std::make_tuple(&position::x, &position::y);
+     *        };
+     *
+     *        such components are handed out as soa_ref<C> by for_each and
+     *        soa_span<C> by for_each_span, never as C&
+     */
+    template <typename C>
+    struct soa_layout;
+
+    template <typename C>
+    concept soa_component = requires {
+        soa_layout<std::remove_const_t<C>>::fields;
+    };
+
+    namespace details {
+        template <typename M>
+        struct member_of;
+
+        template <typename C, typename T>
+        struct member_of<T C::*> {
+            using type = T;
+        };
+
+        template <typename A, typename B>
+        constexpr bool same_member(A a, B b) noexcept {
+            if constexpr (std::is_same_v<A, B>) {
+                return a == b;
+            } else {
+                return false;
+            }
+        }
+    }  // namespace details
+
+    template <soa_component C>
+    inline constexpr size_t soa_field_count = std::tuple_size_v<
+        std::remove_cvref_t<decltype(soa_layout<C>::fields)>>;
+
+    template <soa_component C, size_t I>
+    inline constexpr auto soa_member = std::get<I>(soa_layout<C>::fields);
+
+    /**
+     * @brief component held by the column of the I-th field of C
+     */
+    template <soa_component C, size_t I>
+    struct soa_field {
+        using type = typename details::member_of<
+            std::remove_cv_t<decltype(soa_member<C, I>)>>::type;
+
+        type value;
+    };
+
+    template <soa_component C, size_t I>
+    using soa_field_t = typename soa_field<C, I>::type;
+
+    /**
+     * @brief position of Member in soa_layout<C>::fields
+     */
+    template <soa_component C, auto Member>
+    inline constexpr size_t soa_index
+        = []<size_t... Is>(std::index_sequence<Is...>) {
+              size_t index = sizeof...(Is);
+              ((details::same_member(soa_member<C, Is>, Member)
+                    ? void(index = Is)
+                    : void()),
+               ...);
+              return index;
+          }(std::make_index_sequence<soa_field_count<C>>{});
+
+    /**
+     * @brief ids of the components stored for C, one per field for a soa
+     *        component
+     */
+    template <typename C>
+    inline auto column_ids() {
+        using component = std::remove_cvref_t<C>;
+        if constexpr (soa_component<component>) {
+            return [&]<size_t... Is>(std::index_sequence<Is...>) {
+                return std::array<component_id_t, sizeof...(Is)>{
+                    type_id_generator::get<soa_field<component, Is>>()...};
+            }(std::make_index_sequence<soa_field_count<component>>{});
+        } else {
+            return std::array<component_id_t, 1>{
+                type_id_generator::get<component>()};
+        }
+    }
+
+    namespace details {
+        template <typename C, typename Sequence>
+        struct soa_pointers;
+
+        // const if C is
+        template <typename C, size_t... Is>
+        struct soa_pointers<C, std::index_sequence<Is...>> {
+            using type = std::tuple<std::conditional_t<
+                std::is_const_v<C>,
+                const soa_field_t<std::remove_const_t<C>, Is>,
+                soa_field_t<std::remove_const_t<C>, Is>>*...>;
+        };
+
+        template <typename C>
+        using soa_pointers_t = typename soa_pointers<
+            C,
+            std::make_index_sequence<
+                soa_field_count<std::remove_const_t<C>>>>::type;
+    }  // namespace details
+
+    /**
+     * @brief proxy of the C of an entity whose fields are in separate
+     *        columns, read and written field by field or as a whole
+     */
+    template <soa_component C>
+    class soa_ref {
+       public:
+        using element_type = C;
+        using value_type = std::remove_const_t<C>;
+        using pointers = details::soa_pointers_t<C>;
+
+        explicit soa_ref(const pointers& fields) noexcept : fields_(fields) {}
+
+        template <size_t I>
+        [[nodiscard]] auto& field() const noexcept {
+            return *std::get<I>(fields_);
+        }
+
+        /**
+         * @brief ref.get<&position::x>()
+         */
+        template <auto Member>
+        [[nodiscard]] auto& get() const noexcept {
+            return field<soa_index<value_type, Member>>();
+        }
+
+        [[nodiscard]] operator value_type() const {
+            value_type value{};
+            for_each_field([&]<size_t I>() {
+                value.*soa_member<value_type, I> = field<I>();
+            });
+            return value;
+        }
+
+        const soa_ref& operator=(const value_type& value) const
+            requires(!std::is_const_v<C>) {
+            for_each_field([&]<size_t I>() {
+                field<I>() = value.*soa_member<value_type, I>;
+            });
+            return *this;
+        }
+
+       private:
+        template <typename F>
+        static void for_each_field(F&& f) {
+            [&]<size_t... Is>(std::index_sequence<Is...>) {
+                (f.template operator()<Is>(), ...);
+            }(std::make_index_sequence<soa_field_count<value_type>>{});
+        }
+
+        pointers fields_;
+    };
+
+    /**
+     * @brief rows of a soa component, one std::span per field
+     */
+    template <soa_component C>
+    class soa_span {
+       public:
+        using element_type = C;
+        using value_type = std::remove_const_t<C>;
+        using pointers = details::soa_pointers_t<C>;
+
+        soa_span(const pointers& fields, size_t size) noexcept
+            : fields_(fields), size_(size) {}
+
+        template <size_t I>
+        [[nodiscard]] auto field() const noexcept {
+            return std::span(std::get<I>(fields_), size_);
+        }
+
+        /**
+         * @brief span.get<&position::x>()
+         */
+        template <auto Member>
+        [[nodiscard]] auto get() const noexcept {
+            return field<soa_index<value_type, Member>>();
+        }
+
+        [[nodiscard]] soa_ref<C> operator[](size_t row) const noexcept {
+            return soa_ref<C>(std::apply(
+                [&](auto*... fields) { return pointers{fields + row...}; },
+                fields_));
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return size_; }
+
+       private:
+        pointers fields_;
+        size_t size_;
+    };
+
+    template <typename T>
+    inline constexpr bool is_soa_ref_v = false;
+
+    template <typename C>
+    inline constexpr bool is_soa_ref_v<soa_ref<C>> = true;
+
+    template <typename T>
+    inline constexpr bool is_soa_span_v = false;
+
+    template <typename C>
+    inline constexpr bool is_soa_span_v<soa_span<C>> = true;
+
+}  // namespace ant
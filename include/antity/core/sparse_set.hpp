@@ -0,0 +1,174 @@
+#pragma once
+#include <antity/core/identifier.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ant {
+
+    /**
+     * @brief specialize it as std::true_type to store C in a sparse set
+     *        keyed by entity rather than in the archetypes, for components
+     *        toggled often such as status effects
+     *
+     *        template <>
+     *        struct ant::sparse_storage<burning> : std::true_type {};
+     *
+     *        such components aren't part of the archetype signatures,
+     *        adding or removing one never moves the other components of the
+     *        entity. for_each and get_entity_components join them with the
+     *        archetypes, views, queries, spans and filters can't take them
+     */
+    template <typename C>
+    struct sparse_storage : std::false_type {};
+
+    template <typename C>
+    concept sparse_component = sparse_storage<std::remove_cv_t<C>>::value;
+
+    template <typename... Cs>
+    inline constexpr bool any_sparse_v = (sparse_component<Cs> || ...);
+
+    /**
+     * @brief type erased side of a sparse_set, used by destroy and the
+     *        command buffer playback
+     */
+    class sparse_set_base {
+       public:
+        static constexpr uint32_t _npos = UINT32_MAX;
+
+        virtual ~sparse_set_base() = default;
+
+        [[nodiscard]] bool contains(entity_t entity) const noexcept {
+            return position(entity) != _npos;
+        }
+
+        /**
+         * @brief entities holding the component, in storage order
+         */
+        [[nodiscard]] std::span<const entity_t> entities() const noexcept {
+            return entities_;
+        }
+
+        [[nodiscard]] size_t size() const noexcept { return entities_.size(); }
+
+        /**
+         * @brief removes the component of entity if it has one, the last
+         *        component takes its place
+         */
+        virtual void erase(entity_t entity) = 0;
+
+        /**
+         * @brief adds or replaces the component of entity by the one at
+         *        value, which is moved from then destroyed. a null value is
+         *        default constructed
+         */
+        virtual void relocate(entity_t entity, std::byte* value) = 0;
+
+        virtual void clear() noexcept = 0;
+
+       protected:
+        [[nodiscard]] uint32_t position(entity_t entity) const noexcept {
+            const index_t index = get_entity_index(entity);
+            if (index >= sparse_.size()) {
+                return _npos;
+            }
+            const uint32_t position = sparse_[index];
+            return position != _npos && entities_[position] == entity
+                       ? position
+                       : _npos;
+        }
+
+        void link(entity_t entity, uint32_t position) {
+            const index_t index = get_entity_index(entity);
+            if (index >= sparse_.size()) {
+                sparse_.resize(index + 1, _npos);
+            }
+            sparse_[index] = position;
+        }
+
+        // position in entities_ of each entity index, _npos if none
+        std::vector<uint32_t> sparse_;
+        std::vector<entity_t> entities_;
+    };
+
+    /**
+     * @brief components of the entities in a packed array, found through
+     *        an array indexed by entity index. add and remove are O(1)
+     */
+    template <typename C>
+    class sparse_set final : public sparse_set_base {
+       public:
+        template <typename... Args>
+        C& emplace(entity_t entity, Args&&... args) {
+            const uint32_t found = position(entity);
+            if (found != _npos) {
+                components_[found] = C(std::forward<Args>(args)...);
+                return components_[found];
+            }
+            components_.emplace_back(std::forward<Args>(args)...);
+            link(entity, static_cast<uint32_t>(entities_.size()));
+            entities_.push_back(entity);
+            return components_.back();
+        }
+
+        /**
+         * @return null if entity lacks C
+         */
+        [[nodiscard]] C* find(entity_t entity) noexcept {
+            const uint32_t found = position(entity);
+            return found != _npos ? &components_[found] : nullptr;
+        }
+
+        /**
+         * @brief components in the order of entities()
+         */
+        [[nodiscard]] std::span<C> components() noexcept {
+            return components_;
+        }
+
+        void erase(entity_t entity) override {
+            const uint32_t found = position(entity);
+            if (found == _npos) {
+                return;
+            }
+            if (found + 1 != entities_.size()) {
+                components_[found] = std::move(components_.back());
+                entities_[found] = entities_.back();
+                link(entities_[found], found);
+            }
+            sparse_[get_entity_index(entity)] = _npos;
+            components_.pop_back();
+            entities_.pop_back();
+        }
+
+        void relocate(entity_t entity, std::byte* value) override {
+            if (value == nullptr) {
+                emplace(entity);
+                return;
+            }
+            C* component = std::launder(reinterpret_cast<C*>(value));
+            emplace(entity, std::move(*component));
+            component->~C();
+        }
+
+        void clear() noexcept override {
+            sparse_.clear();
+            entities_.clear();
+            components_.clear();
+        }
+
+       private:
+        std::vector<C> components_;
+    };
+
+    template <typename C>
+    std::unique_ptr<sparse_set_base> make_sparse_set() {
+        return std::make_unique<sparse_set<C>>();
+    }
+
+}  // namespace ant
@@ -2,29 +2,82 @@
 #include <antity/core/archetype.hpp>
 #include <antity/core/archetype_map.hpp>
 #include <antity/core/component_array.hpp>
+#include <iterator>
 
 namespace ant {
 
+    /**
+     * @brief what views hand out for an element, C& for a component, C* for
+     *        an optional_t<C>, null if the archetype lacks it
+     */
+    template <typename C>
+    struct view_element {
+        using value_type = C;
+        using reference = C&;
+        using pointer = C*;
+
+        static reference at(C* block, size_t offset) noexcept {
+            return *address(block, offset);
+        }
+
+        static pointer address(C* block, size_t offset) noexcept {
+            if constexpr (is_tag_v<C>) {
+                return block;
+            } else {
+                return block + offset;
+            }
+        }
+    };
+
+    template <typename C>
+    struct view_element<optional_t<C>> {
+        using value_type = C*;
+        using reference = C*;
+        using pointer = C*;
+
+        static reference at(C* block, size_t offset) noexcept {
+            return block ? view_element<C>::address(block, offset) : nullptr;
+        }
+
+        static pointer address(C* block, size_t offset) noexcept {
+            return at(block, offset);
+        }
+    };
+
     template <typename... Cs>
     class archetype_view final {
         using component_arrays = std::tuple<component_array<Cs>...>;
 
        public:
+        /**
+         * @brief walks the archetype block by block, pointers to the current
+         *        block are cached so that dereferencing is a plain offset
+         */
         class archetype_view_iterator final {
            public:
             using iterator_category = std::random_access_iterator_tag;
             using difference_type = std::ptrdiff_t;
-            using value_type = std::tuple<entity_t, Cs...>;
-            using pointer = std::tuple<entity_t*, Cs*...>;
-            using reference = std::tuple<entity_t&, Cs&...>;
+            using value_type = std::tuple<
+                entity_t, typename view_element<Cs>::value_type...>;
+            using pointer
+                = std::tuple<entity_t*, typename view_element<Cs>::pointer...>;
+            using reference = std::tuple<
+                entity_t&, typename view_element<Cs>::reference...>;
 
             archetype_view_iterator() = default;
 
             archetype_view_iterator(size_t index, archetype_view<Cs...>* owner)
-                : index(index), owner(owner) {}
+                : index(index),
+                  arch(owner->archetype_),
+                  arrays(owner->component_arrays_) {
+                load_block();
+            }
 
             archetype_view_iterator& operator++() noexcept {
-                return ++index, *this;
+                if (++index == block_last) {
+                    load_block();
+                }
+                return *this;
             }
 
             archetype_view_iterator operator++(int) noexcept {
@@ -33,7 +86,11 @@ namespace ant {
             }
 
             archetype_view_iterator& operator--() noexcept {
-                return ++index, *this;
+                // end() may not have loaded a block
+                if (--index < block_first || index >= block_last) {
+                    load_block();
+                }
+                return *this;
             }
 
             archetype_view_iterator operator--(int) noexcept {
@@ -43,7 +100,8 @@ namespace ant {
 
             archetype_view_iterator& operator+=(
                 const difference_type value) noexcept {
-                index -= value;
+                index += value;
+                load_block();
                 return *this;
             }
 
@@ -65,14 +123,13 @@ namespace ant {
 
             difference_type operator-(
                 const archetype_view_iterator& other) const noexcept {
-                return other.index - index;
+                return static_cast<difference_type>(index)
+                       - static_cast<difference_type>(other.index);
             }
 
             [[nodiscard]] reference operator[](
                 const difference_type value) const {
-                return std::tie(owner->archetype->entities[value],
-                                std::get<component_array<Cs>>(
-                                    owner->component_arrays_)[value]...);
+                return *(*this + value);
             }
 
             [[nodiscard]] bool operator==(
@@ -87,12 +144,12 @@ namespace ant {
 
             [[nodiscard]] bool operator<(
                 const archetype_view_iterator& other) const noexcept {
-                return index > other.index;
+                return index < other.index;
             }
 
             [[nodiscard]] bool operator>(
                 const archetype_view_iterator& other) const noexcept {
-                return index < other.index;
+                return index > other.index;
             }
 
             [[nodiscard]] bool operator<=(
@@ -106,20 +163,51 @@ namespace ant {
             }
 
             [[nodiscard]] pointer operator->() const {
-                return pointer{&(owner->archetype_->entities[index]),
-                               &(std::get<component_array<Cs>>(
-                                   owner->component_arrays_)[index])...};
+                return address(index - block_first,
+                               std::index_sequence_for<Cs...>{});
             }
 
             [[nodiscard]] reference operator*() const {
-                return reference{owner->archetype_->entities[index],
-                                 std::get<component_array<Cs>>(
-                                     owner->component_arrays_)[index]...};
+                return dereference(index - block_first,
+                                   std::index_sequence_for<Cs...>{});
             }
 
            private:
-            difference_type index;
-            archetype_view<Cs...>* owner;
+            template <size_t... Is>
+            pointer address(size_t offset,
+                            std::index_sequence<Is...>) const noexcept {
+                return pointer{&entities[offset],
+                               view_element<Cs>::address(
+                                   std::get<Is>(block_data), offset)...};
+            }
+
+            template <size_t... Is>
+            reference dereference(size_t offset,
+                                  std::index_sequence<Is...>) const noexcept {
+                return reference{
+                    entities[offset],
+                    view_element<Cs>::at(std::get<Is>(block_data), offset)...};
+            }
+
+            void load_block() noexcept {
+                if (index >= arch->entities.size()) {
+                    return;
+                }
+                const size_t block = index >> arch->block_shift;
+                block_first = arch->block_begin(block);
+                block_last = arch->block_end(block);
+                entities = arch->entities.data() + block_first;
+                block_data = std::make_tuple(
+                    std::get<component_array<Cs>>(arrays).block(block)...);
+            }
+
+            size_t index{0};
+            size_t block_first{0};
+            size_t block_last{0};
+            entity_t* entities{nullptr};
+            std::tuple<typename view_element<Cs>::pointer...> block_data;
+            archetype* arch{nullptr};
+            component_arrays arrays;
         };
 
         archetype_view() = default;
@@ -136,13 +224,15 @@ namespace ant {
             return archetype_view_iterator(archetype_->entities.size(), this);
         }
 
-        archetype_view_iterator rbegin() {
-            return archetype_view_iterator(archetype_->entities.size(), this);
+        std::reverse_iterator<archetype_view_iterator> rbegin() {
+            return std::reverse_iterator(end());
         }
-        archetype_view_iterator rend() {
-            return archetype_view_iterator(-1, this);
+        std::reverse_iterator<archetype_view_iterator> rend() {
+            return std::reverse_iterator(begin());
         }
 
+        size_t size() const { return archetype_->entities.size(); }
+
        private:
         archetype* archetype_;
         component_arrays component_arrays_;
@@ -157,7 +247,6 @@ namespace ant {
     template <typename... Cs>
     class archetype_map_view {
        public:
-        using archeytpe_key_iterator = std::vector<archetype_key>::iterator;
         using archetype_iterator
             = archetype_view<Cs...>::archetype_view_iterator;
         class archetyep_map_iterator {
@@ -168,33 +257,16 @@ namespace ant {
             using pointer = archetype_iterator::pointer;
             using reference = archetype_iterator::reference;
 
-            archetyep_map_iterator(
-                archeytpe_key_iterator arch_signature_iterator,
-                archetype_map_view* owner)
-                : archetype_signature_iterator_(arch_signature_iterator),
-                  owner(owner) {
-                if (archetype_signature_iterator_
-                    != owner->archetype_map_->signatures_end()) {
-                    current_view_ = archetype_view<Cs...>(
-                        owner->archetype_map_->get(*archetype_signature_iterator_));
-                    archetype_view_iterator_ = current_view_.begin();
-                    archetype_view_end_ = current_view_.end();
-                }
+            archetyep_map_iterator(size_t archetype_index,
+                                   archetype_map_view* owner)
+                : archetype_index_(archetype_index), owner(owner) {
+                seek_archetype();
             }
 
             archetyep_map_iterator& operator++() noexcept {
                 if (++archetype_view_iterator_ == archetype_view_end_) {
-                    do {
-                        if (++archetype_signature_iterator_
-                            == owner->archetype_map_->signatures_end()) {
-                            return *this;
-                        }
-                    } while (!archetype_signature_iterator_->match(archetype_key{owner->include_,owner->chunk_id_}));
-
-                    current_view_ = archetype_view<Cs...>(
-                        owner->archetype_map_->get(*archetype_signature_iterator_));
-                    archetype_view_iterator_ = current_view_.begin();
-                    archetype_view_end_ = current_view_.end();
+                    ++archetype_index_;
+                    seek_archetype();
                 }
                 return *this;
             }
@@ -206,8 +278,7 @@ namespace ant {
 
             [[nodiscard]] bool operator==(
                 const archetyep_map_iterator& other) const noexcept {
-                return other.archetype_signature_iterator_
-                       == archetype_signature_iterator_;
+                return other.archetype_index_ == archetype_index_;
             }
 
             [[nodiscard]] bool operator!=(
@@ -224,31 +295,95 @@ namespace ant {
             }
 
            private:
+            /**
+             * @brief moves to the first matching archetype holding entities,
+             *        empty archetypes are kept alive by the archetype_map
+             */
+            void seek_archetype() {
+                const archetype_key& include = owner->include_;
+                archetype_map& map = *owner->archetype_map_;
+                const auto& keys = map.keys();
+                for (; archetype_index_ < keys.size(); ++archetype_index_) {
+                    if (!keys[archetype_index_].match(include)
+                        || !owner->mask_.accepts(
+                            keys[archetype_index_].signature)) {
+                        continue;
+                    }
+                    archetype* arch = map[archetype_index_];
+                    if (arch->entities.empty()) {
+                        continue;
+                    }
+                    current_view_ = archetype_view<Cs...>(arch);
+                    archetype_view_iterator_ = current_view_.begin();
+                    archetype_view_end_ = current_view_.end();
+                    return;
+                }
+            }
+
             archetype_view<Cs...> current_view_;
             archetype_iterator archetype_view_iterator_;
             archetype_iterator archetype_view_end_;
-            archeytpe_key_iterator archetype_signature_iterator_;
+            // position in the dense archetype array of the archetype_map
+            size_t archetype_index_;
             archetype_map_view* owner;
         };
 
         archetype_map_view(archetype_map* arch_map, signature_t include, chunk_id_t chunk_id)
-            : archetype_map_(arch_map), include_(include), chunk_id_(chunk_id) {}
+            : archetype_map_(arch_map), include_{std::move(include), chunk_id} {}
+
+        /**
+         * @param mask include components, archetypes also have to pass its
+         *        exclude and any_of conditions
+         */
+        archetype_map_view(archetype_map* arch_map, query_mask mask,
+                           chunk_id_t chunk_id)
+            : archetype_map_(arch_map),
+              include_{mask.include, chunk_id},
+              mask_(std::move(mask)) {}
+
+        /**
+         * @brief tag the rows of arch as written for the elements handed
+         *        out as non const references or pointers
+         */
+        template <typename Handler>
+        static void mark_written(Handler& handler, archetype* arch) {
+            handler.template mark_written<
+                typename view_element<Cs>::reference...>(
+                arch, 0, arch->entities.size());
+        }
 
         inline auto begin() {
-            return archetyep_map_iterator{
-                archetype_map_->signatures_begin(archetype_key{include_,chunk_id_}), this};
+            return archetyep_map_iterator{0, this};
         }
 
         inline auto end() {
-            return archetyep_map_iterator{archetype_map_->signatures_end(), this};
+            return archetyep_map_iterator{archetype_map_->size(), this};
         }
 
        private:
-        chunk_id_t chunk_id_;
-        signature_t include_;
         archetype_map* archetype_map_;
+        archetype_key include_;
+        query_mask mask_;
     };
 
+    /**
+     * @brief archetype_map_view of the components of View followed by the
+     *        optional_t filters
+     */
+    template <typename View, typename... Filters>
+    struct filtered_view {
+        using type = View;
+    };
+
+    template <typename... Cs, typename C, typename... Filters>
+    struct filtered_view<archetype_map_view<Cs...>, optional_t<C>, Filters...>
+        : filtered_view<archetype_map_view<Cs..., optional_t<C>>, Filters...> {
+    };
+
+    template <typename... Cs, typename Filter, typename... Filters>
+    struct filtered_view<archetype_map_view<Cs...>, Filter, Filters...>
+        : filtered_view<archetype_map_view<Cs...>, Filters...> {};
+
     template <typename... Cs>
     class multi_archetype_view final {
         using underlying_views = typename std::vector<archetype_view<Cs...>>;
@@ -338,18 +473,21 @@ namespace ant {
         component_id_list component_id_list, archetype_map* archetype_map,
         chunk_id_t chunk_id = _null_chunk) {
         multi_archetype_view<Cs...> multiarchetypeView;
-        for (auto&& archetype : *archetype_map->get()) {
-            if (!std::ranges::includes(archetype.second->component_ids.begin(),
-                                       archetype.second->component_ids.end(),
-                                       component_id_list.begin(),
-                                       component_id_list.end())) {
+        for (size_t i = 0; i < archetype_map->size(); ++i) {
+            archetype* archetype = (*archetype_map)[i];
+            // tags are only in the signature
+            if (!std::ranges::all_of(component_id_list,
+                                     [&](component_id_t component_id) {
+                                         return archetype->key.signature.test(
+                                             component_id);
+                                     })) {
                 continue;
             }
-            if (archetype.second->key.chunk_id != chunk_id
+            if (archetype->key.chunk_id != chunk_id
                 && chunk_id != _null_chunk) {
                 continue;
             }
-            multiarchetypeView.emplace_back(archetype.second.get());
+            multiarchetypeView.emplace_back(archetype);
         }
         return multiarchetypeView;
     }
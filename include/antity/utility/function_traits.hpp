@@ -1,6 +1,7 @@
 #pragma once
 #include <concepts>
 #include <functional>
+#include <type_traits>
 
 template <typename... Args>
 struct type_list {};
@@ -26,6 +27,8 @@ struct function_traits {};
 
 template <typename F>
 struct functor_traits {
-    using args_type = decltype(details::args_helper(&F::operator()));
-    using return_type = decltype(details::ret_helper(&F::operator())); 
+    using args_type = decltype(details::args_helper(
+        &std::remove_cvref_t<F>::operator()));
+    using return_type = decltype(details::ret_helper(
+        &std::remove_cvref_t<F>::operator()));
 };
\ No newline at end of file
@@ -1,6 +1,9 @@
 #pragma once
+#include <bit>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <limits>
 #include <vector>
 
@@ -22,7 +25,8 @@ namespace ant {
             uint64_t p = 0x5555555555555555;  // pattern of alternating 0 and 1
             uint64_t c
                 = 17316035218449499591ull;  // random uneven integer constant;
-            return c * xorshift(p * xorshift(n, 32), 32);
+            return c
+                   * xorshift(p * xorshift(static_cast<uint64_t>(n), 32), 32);
         }
 
         template <class T>
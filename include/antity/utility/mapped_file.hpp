@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ANT_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define ANT_HAS_MMAP 0
+#endif
+
+namespace ant {
+
+    /**
+     * @brief private read write mapping of a whole file. pages are shared
+     *        with the page cache until written to, the os then copies them,
+     *        so writes never reach the file
+     */
+    class mapped_file {
+       public:
+        static constexpr size_t _page_size = 4096;
+
+        /**
+         * @throw std::runtime_error if the file can't be opened or mapped,
+         * or memory mapping isn't available on this platform
+         */
+        explicit mapped_file(const std::string& path) {
+#if ANT_HAS_MMAP
+            const int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error("can't open " + path);
+            }
+            struct stat status {};
+            if (::fstat(fd, &status) != 0) {
+                ::close(fd);
+                throw std::runtime_error("can't stat " + path);
+            }
+            size_ = static_cast<size_t>(status.st_size);
+            if (size_ > 0) {
+                void* data = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error("can't map " + path);
+                }
+                data_ = static_cast<std::byte*>(data);
+            }
+            // the mapping keeps its own reference to the file
+            ::close(fd);
+#else
+            (void)path;
+            throw std::runtime_error("memory mapping isn't supported");
+#endif
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        mapped_file(mapped_file&& other) noexcept
+            : data_(std::exchange(other.data_, nullptr)),
+              size_(std::exchange(other.size_, 0)) {}
+
+        mapped_file& operator=(mapped_file&& other) noexcept {
+            if (this != &other) {
+                unmap();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+            }
+            return *this;
+        }
+
+        ~mapped_file() { unmap(); }
+
+        [[nodiscard]] std::byte* data() const noexcept { return data_; }
+        [[nodiscard]] size_t size() const noexcept { return size_; }
+
+       private:
+        void unmap() noexcept {
+#if ANT_HAS_MMAP
+            if (data_) {
+                ::munmap(data_, size_);
+            }
+#endif
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        std::byte* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+}  // namespace ant
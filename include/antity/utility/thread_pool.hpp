@@ -0,0 +1,189 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ant {
+
+    /**
+     * @brief work stealing thread pool, every worker owns a queue, pops its
+     *        own tasks last in first out and steals the oldest tasks of the
+     *        other workers when it runs dry
+     */
+    class thread_pool {
+       public:
+        using task = std::function<void()>;
+
+        /**
+         * @param worker_count number of worker threads, the thread calling
+         *        wait also executes tasks
+         */
+        explicit thread_pool(
+            size_t worker_count = std::thread::hardware_concurrency()) {
+            worker_count = std::max<size_t>(worker_count, 1);
+            for (size_t i = 0; i < worker_count; ++i) {
+                queues_.push_back(std::make_unique<worker_queue>());
+            }
+            for (size_t i = 0; i < worker_count; ++i) {
+                workers_.emplace_back([this, i] { work(i); });
+            }
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        ~thread_pool() {
+            {
+                std::lock_guard lock(sleep_mutex_);
+                stop_ = true;
+            }
+            sleep_cv_.notify_all();
+            for (auto& worker : workers_) {
+                worker.join();
+            }
+        }
+
+        /**
+         * @brief queue a task, tasks submitted from a worker go to its own
+         *        queue, others are spread round robin
+         */
+        void submit(task t) {
+            size_t queue = current_worker_ != nullptr
+                                   && current_worker_->pool == this
+                               ? current_worker_->index
+                               : next_queue_++ % queues_.size();
+            pending_.fetch_add(1, std::memory_order_relaxed);
+            {
+                std::lock_guard lock(queues_[queue]->mutex);
+                queues_[queue]->tasks.push_back(std::move(t));
+            }
+            {
+                std::lock_guard lock(sleep_mutex_);
+                queued_++;
+            }
+            sleep_cv_.notify_one();
+        }
+
+        /**
+         * @brief blocks until every submitted task ran, the calling thread
+         *        executes tasks meanwhile. rethrows the first exception
+         *        thrown by a task
+         */
+        void wait() {
+            while (pending_.load(std::memory_order_acquire) > 0) {
+                if (!run_one(0)) {
+                    std::this_thread::yield();
+                }
+            }
+            std::exception_ptr error;
+            {
+                std::lock_guard lock(error_mutex_);
+                std::swap(error, error_);
+            }
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        [[nodiscard]] size_t size() const { return workers_.size(); }
+
+       private:
+        struct worker_queue {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+
+        struct worker_id {
+            const thread_pool* pool;
+            size_t index;
+        };
+
+        void work(size_t index) {
+            worker_id id{this, index};
+            current_worker_ = &id;
+            while (true) {
+                {
+                    std::unique_lock lock(sleep_mutex_);
+                    sleep_cv_.wait(lock, [&] { return stop_ || queued_ > 0; });
+                    if (stop_) {
+                        return;
+                    }
+                }
+                run_one(index);
+            }
+        }
+
+        /**
+         * @brief run one task, from the given queue first then stealing
+         * @return false if every queue was empty
+         */
+        bool run_one(size_t index) {
+            task t;
+            if (!pop(index, t)) {
+                return false;
+            }
+            try {
+                t();
+            } catch (...) {
+                std::lock_guard lock(error_mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+            }
+            pending_.fetch_sub(1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(size_t index, task& t) {
+            {
+                auto& own = *queues_[index];
+                std::lock_guard lock(own.mutex);
+                if (!own.tasks.empty()) {
+                    t = std::move(own.tasks.back());
+                    own.tasks.pop_back();
+                    on_dequeue();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < queues_.size(); ++i) {
+                auto& victim = *queues_[(index + i) % queues_.size()];
+                std::lock_guard lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    t = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    on_dequeue();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void on_dequeue() {
+            std::lock_guard lock(sleep_mutex_);
+            queued_--;
+        }
+
+        inline static thread_local worker_id* current_worker_ = nullptr;
+
+        std::vector<std::unique_ptr<worker_queue>> queues_;
+        std::vector<std::thread> workers_;
+        std::atomic<size_t> pending_{0};
+        std::atomic<size_t> next_queue_{0};
+
+        std::mutex sleep_mutex_;
+        std::condition_variable sleep_cv_;
+        size_t queued_{0};
+        bool stop_{false};
+
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+
+}  // namespace ant
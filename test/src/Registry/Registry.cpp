@@ -1,6 +1,14 @@
 #include <gtest/gtest.h>
 
 #include <antity/core/registry.hpp>
+#include <antity/core/scheduler.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
 
 using namespace ant;
 
@@ -125,4 +133,1661 @@ TEST(registry, for_each) {
     ASSERT_EQ(counter, 1);
 
 
-}
\ No newline at end of file
+}
+TEST(registry, chunked_storage) {
+    registry reg{storage_config{storage_policy::chunked, 64}};
+
+    reg.save<int>();
+    reg.save<float>();
+
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 100; i++) {
+        entity_t entity = reg.create();
+        reg.add<int>(entity, i);
+        reg.add<float>(entity, static_cast<float>(i));
+        entities.push_back(entity);
+    }
+
+    auto [first] = reg.get_entity_components<int>(entities.front());
+    int* first_address = &first;
+    for (int i = 0; i < 100; i++) {
+        reg.create<int, float>(_null_chunk, 100 + i, 100.f + i);
+    }
+    auto [still_first] = reg.get_entity_components<int>(entities.front());
+    ASSERT_EQ(&still_first, first_address);
+
+    int sum = 0;
+    int counter = 0;
+    reg.for_each([&](entity_t e, int& i, float& f) {
+        ASSERT_EQ(static_cast<float>(i), f);
+        sum += i;
+        counter++;
+    });
+    ASSERT_EQ(counter, 200);
+    ASSERT_EQ(sum, 199 * 200 / 2);
+
+    counter = 0;
+    for (auto [e, i, f] : reg.get<int, float>()) {
+        ASSERT_EQ(static_cast<float>(i), f);
+        counter++;
+    }
+    ASSERT_EQ(counter, 200);
+
+    for (size_t i = 0; i < 50; i++) {
+        reg.remove<float>(entities[i]);
+    }
+    counter = 0;
+    reg.for_each([&](entity_t e, int& i, float& f) {
+        ASSERT_EQ(static_cast<float>(i), f);
+        counter++;
+    });
+    ASSERT_EQ(counter, 150);
+    for (size_t i = 0; i < 50; i++) {
+        auto [j] = reg.get_entity_components<int>(entities[i]);
+        ASSERT_EQ(j, static_cast<int>(i));
+    }
+}
+
+struct alignas(32) simd_vec {
+    float v[8];
+};
+
+struct alignas(64) cache_line {
+    int value;
+};
+
+class counting_resource : public std::pmr::memory_resource {
+   public:
+    size_t allocated{0};
+    size_t outstanding{0};
+
+   private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocated++;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+TEST(registry, over_aligned_components) {
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry reg{storage_config{policy}};
+        for (int i = 0; i < 100; i++) {
+            reg.create<int, simd_vec, cache_line>(_null_chunk, int{i}, {}, {i});
+        }
+        reg.for_each([](entity_t e, int& i, simd_vec& v, cache_line& c) {
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(&v) % alignof(simd_vec), 0u);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(&c) % alignof(cache_line),
+                      0u);
+            ASSERT_EQ(i, c.value);
+        });
+    }
+}
+
+TEST(registry, memory_resource) {
+    counting_resource resource;
+    {
+        registry reg{storage_config{storage_policy::contiguous,
+                                    _default_block_size, &resource}};
+        for (int i = 0; i < 100; i++) {
+            entity_t entity = reg.create();
+            reg.add<int>(entity, i);
+            reg.add<float>(entity, 1.f);
+        }
+        ASSERT_GT(resource.allocated, 0u);
+        ASSERT_GT(resource.outstanding, 0u);
+    }
+    ASSERT_EQ(resource.outstanding, 0u);
+}
+
+struct tracked {
+    inline static int alive = 0;
+    // addresses of the live objects, moving from or destroying any other
+    // one is a misuse
+    inline static std::set<const tracked*> live;
+    inline static int misuses = 0;
+    std::string name;
+
+    tracked(std::string name = {}) : name(std::move(name)) { born(); }
+    tracked(tracked&& other) : name(std::move(other.name)) {
+        misuses += !live.contains(&other);
+        born();
+    }
+    ~tracked() {
+        misuses += live.erase(this) == 0;
+        alive--;
+    }
+
+   private:
+    void born() {
+        misuses += !live.insert(this).second;
+        alive++;
+    }
+};
+
+TEST(registry, relocate_components) {
+    static_assert(is_trivially_relocatable_v<int2>);
+    static_assert(!is_trivially_relocatable_v<tracked>);
+    {
+        registry reg;
+        std::vector<entity_t> entities;
+        for (int i = 0; i < 100; i++) {
+            entity_t entity = reg.create();
+            reg.add<tracked>(entity, std::to_string(i));
+            reg.add<int>(entity, i);
+            entities.push_back(entity);
+        }
+        ASSERT_EQ(tracked::alive, 100);
+        for (size_t i = 0; i < 50; i++) {
+            reg.remove<int>(entities[i]);
+        }
+        ASSERT_EQ(tracked::alive, 100);
+        for (size_t i = 0; i < entities.size(); i++) {
+            auto [t] = reg.get_entity_components<tracked>(entities[i]);
+            ASSERT_EQ(t.name, std::to_string(i));
+        }
+
+        // the rows left behind are shrunk away once they are gone
+        std::vector<entity_t> removed;
+        for (int i = 0; i < 16; i++) {
+            removed.push_back(reg.create<int2, tracked>(
+                _null_chunk, int2{}, tracked{std::to_string(i)}));
+        }
+        for (entity_t entity : removed) {
+            reg.remove<tracked>(entity);
+        }
+        ASSERT_EQ(tracked::alive, 100);
+        for (size_t i = 0; i < entities.size(); i++) {
+            reg.remove<tracked>(entities[i]);
+        }
+        ASSERT_EQ(tracked::alive, 0);
+    }
+    ASSERT_EQ(tracked::alive, 0);
+    ASSERT_EQ(tracked::misuses, 0);
+    ASSERT_TRUE(tracked::live.empty());
+}
+
+TEST(registry, archetype_edges) {
+    registry reg;
+
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 10; i++) {
+        entity_t entity = reg.create();
+        reg.add<int>(entity, i);
+        reg.add<float>(entity, 1.f);
+        reg.add<char>(entity, 'a');
+        entities.push_back(entity);
+    }
+
+    int counter = 0;
+    for (auto [e, i] : reg.get<int>()) {
+        counter++;
+    }
+    ASSERT_EQ(counter, 10);
+
+    for (auto entity : entities) {
+        reg.remove<char>(entity);
+        reg.remove<float>(entity);
+    }
+    reg.collect_empty_archetypes();
+
+    for (auto entity : entities) {
+        reg.add<float>(entity, 2.f);
+        reg.add<char>(entity, 'b');
+        reg.remove<float>(entity);
+    }
+
+    counter = 0;
+    reg.for_each([&](entity_t e, int& i, char& c) {
+        ASSERT_EQ(c, 'b');
+        counter++;
+    });
+    ASSERT_EQ(counter, 10);
+
+    for (auto entity : entities) {
+        reg.remove<int>(entity);
+        reg.remove<char>(entity);
+    }
+    reg.collect_empty_archetypes();
+    counter = 0;
+    for (auto [e, i] : reg.get<int>()) {
+        counter++;
+    }
+    ASSERT_EQ(counter, 0);
+}
+
+TEST(registry, remove_missing_component) {
+    registry reg;
+
+    entity_t first = reg.create();
+    reg.add<int>(first, 1);
+    reg.add<float>(first, 1.f);
+    entity_t second = reg.create();
+    reg.add<int>(second, 2);
+    reg.add<float>(second, 2.f);
+
+    // no edge may be cached from {int, float} to itself
+    reg.remove<char>(first);
+    reg.add<char>(second, 'b');
+
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<int>(first)), 1);
+    ASSERT_THROW(reg.get_entity_components<char>(first), std::out_of_range);
+    auto [i, f, c] = reg.get_entity_components<int, float, char>(second);
+    ASSERT_EQ(i, 2);
+    ASSERT_EQ(f, 2.f);
+    ASSERT_EQ(c, 'b');
+
+    // an entity without components has nothing to remove
+    entity_t empty = reg.create();
+    reg.remove<int>(empty);
+    ASSERT_TRUE(reg.valid(empty));
+}
+
+// neither move assignable nor nothrow move constructible
+struct frozen {
+    const int value;
+    explicit frozen(int value = 0) : value(value) {
+        if (value < 0) {
+            throw std::invalid_argument("frozen");
+        }
+    }
+    frozen(frozen&& other) noexcept(false) : value(other.value) {}
+};
+
+TEST(registry, add_held_component) {
+    registry reg;
+
+    entity_t entity = reg.create();
+    reg.add<int>(entity, 1);
+    reg.add<std::string>(entity, "first");
+    entity_t other = reg.create();
+    reg.add<int>(other, 2);
+    reg.add<std::string>(other, "other");
+
+    reg.add<std::string>(entity, "second");
+    reg.add<int>(entity, 3);
+
+    auto [i, s] = reg.get_entity_components<int, std::string>(entity);
+    ASSERT_EQ(i, 3);
+    ASSERT_EQ(s, "second");
+    auto [j, t] = reg.get_entity_components<int, std::string>(other);
+    ASSERT_EQ(j, 2);
+    ASSERT_EQ(t, "other");
+
+    int counter = 0;
+    reg.for_each([&](entity_t e, int&, std::string&) { counter++; });
+    ASSERT_EQ(counter, 2);
+
+    reg.add<frozen>(entity, 1);
+    reg.add<frozen>(other, 2);
+    reg.add<frozen>(entity, 3);
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<frozen>(entity)).value, 3);
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<frozen>(other)).value, 2);
+    // a throwing constructor leaves the held value untouched
+    ASSERT_THROW(reg.add<frozen>(entity, -1), std::invalid_argument);
+    ASSERT_THROW(reg.add<std::string>(entity, std::string::npos, 'x'),
+                 std::length_error);
+    auto [f, u] = reg.get_entity_components<frozen, std::string>(entity);
+    ASSERT_EQ(f.value, 3);
+    ASSERT_EQ(u, "second");
+}
+
+TEST(registry, create_n) {
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry reg{storage_config{policy, 256}};
+        entity_t single = reg.create<int, float>(0, 7, 7.f);
+
+        auto prototypes = reg.create_n<int, float>(1000, 0, 1, 2.f);
+        ASSERT_EQ(prototypes.size(), 1000u);
+
+        auto generated = reg.create_n<int, float>(1000, 0, [](size_t i) {
+            return std::make_tuple(static_cast<int>(i), static_cast<float>(i));
+        });
+
+        std::vector<std::tuple<int, float>> values{{-1, -1.f}, {-2, -2.f}};
+        auto ranged = reg.create_range<int, float>(0, values);
+
+        std::set<entity_t> unique{prototypes.begin(), prototypes.end()};
+        unique.insert(generated.begin(), generated.end());
+        unique.insert(ranged.begin(), ranged.end());
+        unique.insert(single);
+        ASSERT_EQ(unique.size(), 2003u);
+
+        for (auto entity : prototypes) {
+            auto [i, f] = reg.get_entity_components<int, float>(entity);
+            ASSERT_EQ(i, 1);
+            ASSERT_EQ(f, 2.f);
+        }
+        for (size_t e = 0; e < generated.size(); e++) {
+            auto [i, f] = reg.get_entity_components<int, float>(generated[e]);
+            ASSERT_EQ(i, static_cast<int>(e));
+            ASSERT_EQ(f, static_cast<float>(e));
+        }
+        auto [r] = reg.get_entity_components<int>(ranged[1]);
+        ASSERT_EQ(r, -2);
+        auto [s] = reg.get_entity_components<int>(single);
+        ASSERT_EQ(s, 7);
+
+        int counter = 0;
+        reg.for_each([&](entity_t e, int& i, float& f) { counter++; }, 0);
+        ASSERT_EQ(counter, 2003);
+    }
+
+    // rows built before init throws are destroyed
+    registry reg;
+    reg.create<int, tracked>(0, 0, tracked{});
+    ASSERT_EQ(tracked::alive, 1);
+    ASSERT_THROW((reg.create_n<int, tracked>(10, 0,
+                                             [](size_t i) {
+                                                 if (i == 5) {
+                                                     throw std::runtime_error(
+                                                         "init");
+                                                 }
+                                                 return std::make_tuple(
+                                                     static_cast<int>(i),
+                                                     tracked{});
+                                             })),
+                 std::runtime_error);
+    ASSERT_EQ(tracked::alive, 1);
+    int counter = 0;
+    reg.for_each([&](entity_t, int&, tracked&) { counter++; }, 0);
+    ASSERT_EQ(counter, 1);
+}
+
+TEST(registry, generational_entities) {
+    registry reg;
+    entity_t entity = reg.create();
+    ASSERT_TRUE(reg.valid(entity));
+    ASSERT_FALSE(reg.valid(_null_entity));
+
+    reg.remove(entity);
+    ASSERT_FALSE(reg.valid(entity));
+
+    entity_t recycled = reg.create();
+    ASSERT_EQ(get_entity_index(recycled), get_entity_index(entity));
+    ASSERT_NE(recycled, entity);
+    ASSERT_TRUE(reg.valid(recycled));
+    ASSERT_FALSE(reg.valid(entity));
+
+    reg.add<int>(recycled, 3);
+    ASSERT_THROW(reg.add<int>(entity, 4), std::runtime_error);
+    ASSERT_THROW(reg.get_entity_components<int>(entity), std::out_of_range);
+    auto [i] = reg.get_entity_components<int>(recycled);
+    ASSERT_EQ(i, 3);
+}
+
+TEST(registry, destroy) {
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        {
+            registry reg{storage_config{policy, 256}};
+            std::vector<entity_t> entities;
+            for (int i = 0; i < 100; i++) {
+                entity_t entity = reg.create();
+                reg.add<int>(entity, i);
+                reg.add<tracked>(entity, std::to_string(i));
+                entities.push_back(entity);
+            }
+            entity_t bare = reg.create();
+
+            reg.destroy(entities[0]);
+            reg.destroy(bare);
+            ASSERT_FALSE(reg.valid(entities[0]));
+            ASSERT_FALSE(reg.valid(bare));
+            ASSERT_EQ(tracked::alive, 99);
+
+            std::vector<entity_t> odd;
+            for (size_t i = 1; i < entities.size(); i += 2) {
+                odd.push_back(entities[i]);
+            }
+            odd.push_back(entities[1]);
+            odd.push_back(entities[0]);
+            reg.destroy(odd);
+            ASSERT_EQ(tracked::alive, 49);
+
+            reg.destroy_if([](entity_t e, int& i) { return i % 4 == 0; });
+            ASSERT_EQ(tracked::alive, 25);
+
+            int counter = 0;
+            reg.for_each([&](entity_t e, int& i, tracked& t) {
+                ASSERT_EQ(i % 4, 2);
+                ASSERT_EQ(t.name, std::to_string(i));
+                ASSERT_EQ(e, entities[i]);
+                counter++;
+            });
+            ASSERT_EQ(counter, 25);
+            for (size_t i = 0; i < entities.size(); i++) {
+                ASSERT_EQ(reg.valid(entities[i]), i % 4 == 2);
+            }
+        }
+        ASSERT_EQ(tracked::alive, 0);
+    }
+}
+
+TEST(registry, query) {
+    registry reg;
+    auto ints = reg.query<int>();
+    auto int_floats = reg.query<int, float>(0);
+    ASSERT_TRUE(ints.archetypes().empty());
+
+    for (int i = 0; i < 10; i++) {
+        entity_t entity = reg.create();
+        reg.add<int>(entity, i);
+        if (i % 2) {
+            reg.add<char>(entity, 'c');
+        }
+    }
+    reg.create<int, float>(0, 1, 1.f);
+
+    ASSERT_EQ(ints.archetypes().size(), 2u);
+    ASSERT_EQ(int_floats.archetypes().size(), 1u);
+
+    int counter = 0;
+    ints.for_each([&](entity_t e, int& i) { counter++; });
+    ASSERT_EQ(counter, 10);
+
+    counter = 0;
+    for (auto [e, i, f] : int_floats) {
+        ASSERT_EQ(i, 1);
+        counter++;
+    }
+    ASSERT_EQ(counter, 1);
+
+    reg.destroy_if([](entity_t e, char& c) { return true; });
+    reg.collect_empty_archetypes();
+    ASSERT_EQ(ints.archetypes().size(), 1u);
+
+    auto late = reg.query<int>();
+    ASSERT_EQ(late.archetypes().size(), 1u);
+    counter = 0;
+    for (auto [e, i] : late) {
+        ASSERT_EQ(i % 2, 0);
+        counter++;
+    }
+    ASSERT_EQ(counter, 5);
+}
+
+TEST(registry, par_for_each) {
+    registry reg(storage_config{storage_policy::chunked, 1024});
+    reg.set_worker_count(4);
+    constexpr int count = 100000;
+    reg.create_n<int>(count, _null_chunk,
+                      [](size_t i) { return std::tuple{static_cast<int>(i)}; });
+    for (int i = 0; i < 100; i++) {
+        reg.create<int, float>(_null_chunk, int{i}, 0.f);
+    }
+
+    std::atomic<int64_t> sum = 0;
+    std::atomic<int> visited = 0;
+    reg.par_for_each([&](entity_t e, int& i) {
+        sum += i;
+        visited++;
+        i++;
+    });
+    ASSERT_EQ(visited, count + 100);
+    ASSERT_EQ(sum, int64_t{count} * (count - 1) / 2 + 99 * 100 / 2);
+
+    int64_t sum_after = 0;
+    reg.for_each([&](entity_t e, int& i) { sum_after += i; });
+    ASSERT_EQ(sum_after, sum + count + 100);
+
+    visited = 0;
+    reg.par_for_each([&](entity_t e, int& i, float& f) { visited++; });
+    ASSERT_EQ(visited, 100);
+
+    ASSERT_THROW(reg.par_for_each([&](entity_t e, int& i) { reg.create(); }),
+                 std::logic_error);
+    ASSERT_THROW(reg.par_for_each([&](entity_t e, int& i) {
+        if (i == 42) {
+            throw std::runtime_error("task");
+        }
+    }),
+                 std::runtime_error);
+    entity_t entity = reg.create();
+    reg.add<int>(entity, 0);
+    ASSERT_TRUE(reg.valid(entity));
+}
+
+TEST(registry, command_buffer) {
+    registry reg;
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 10; i++) {
+        entities.push_back(reg.create<int>(_null_chunk, int{i}));
+    }
+
+    command_buffer buffer;
+    reg.for_each([&](entity_t e, int& i) {
+        if (i % 2) {
+            buffer.add<float>(e, static_cast<float>(i));
+            buffer.add<std::string>(e, "odd");
+        }
+        if (i == 4) {
+            buffer.destroy(e);
+            buffer.add<float>(e, 4.f);
+        }
+        if (i == 6) {
+            buffer.add<float>(e, 1.f);
+            buffer.remove<float>(e);
+        }
+        if (i == 8) {
+            buffer.remove<int>(e);
+        }
+    });
+    entity_t created = buffer.create();
+    buffer.add<int>(created, 42);
+    buffer.add<int>(created, 43);
+    buffer.add<std::string>(created, "created");
+    ASSERT_FALSE(reg.valid(created));
+
+    reg.apply(buffer);
+    ASSERT_TRUE(buffer.empty());
+
+    ASSERT_FALSE(reg.valid(entities[4]));
+    ASSERT_TRUE(reg.valid(entities[8]));
+    for (int i : {1, 3, 5, 7, 9}) {
+        auto [integer, f, s] = reg.get_entity_components<int, float, std::string>(
+            entities[i]);
+        ASSERT_EQ(integer, i);
+        ASSERT_EQ(f, static_cast<float>(i));
+        ASSERT_EQ(s, "odd");
+    }
+    int counter = 0;
+    reg.for_each([&](entity_t e, int& i) { counter++; });
+    ASSERT_EQ(counter, 10 - 1 - 1 + 1);
+
+    counter = 0;
+    reg.for_each([&](entity_t e, int& i, std::string& s) {
+        if (s == "created") {
+            ASSERT_EQ(i, 43);
+        }
+        counter++;
+    });
+    ASSERT_EQ(counter, 6);
+
+    buffer.add<float>(entities[1], 10.f);
+    buffer.add<tracked>(entities[2], "dropped");
+    buffer.destroy(entities[2]);
+    reg.apply(buffer);
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<float>(entities[1])), 10.f);
+    ASSERT_EQ(tracked::alive, 0);
+
+    // placeholders of another buffer are rejected when recorded
+    command_buffer other;
+    other.create();
+    entity_t foreign = other.create();
+    buffer.create();
+    ASSERT_THROW(buffer.add<int>(foreign, 0), std::invalid_argument);
+    ASSERT_THROW(buffer.remove<int>(foreign), std::invalid_argument);
+    ASSERT_THROW(buffer.destroy(foreign), std::invalid_argument);
+    reg.apply(buffer);
+    ASSERT_TRUE(buffer.empty());
+
+    concurrent_command_buffer buffers;
+    reg.set_worker_count(4);
+    reg.par_for_each([&](entity_t e, int& i) { buffers.local().destroy(e); });
+    reg.apply(buffers);
+    counter = 0;
+    reg.for_each([&](entity_t e, int& i) { counter++; });
+    ASSERT_EQ(counter, 0);
+}
+
+template <size_t N>
+struct numbered {
+    size_t value = N;
+};
+
+TEST(registry, many_component_types) {
+    registry reg;
+    entity_t entity = reg.create();
+    entity_t other = reg.create();
+    [&]<size_t... Ns>(std::index_sequence<Ns...>) {
+        (reg.add<numbered<Ns>>(entity), ...);
+        (reg.add<numbered<Ns>>(other, numbered<Ns>{Ns * 2}), ...);
+    }(std::make_index_sequence<150>{});
+    ASSERT_GT(type_id_generator::get<numbered<149>>(), 128u);
+
+    auto [first, last]
+        = reg.get_entity_components<numbered<0>, numbered<149>>(entity);
+    ASSERT_EQ(first.value, 0u);
+    ASSERT_EQ(last.value, 149u);
+
+    int counter = 0;
+    reg.for_each([&](entity_t e, numbered<3>& a, numbered<140>& b) {
+        ASSERT_EQ(b.value, e == entity ? 140u : 280u);
+        counter++;
+    });
+    ASSERT_EQ(counter, 2);
+
+    reg.remove<numbered<140>>(other);
+    counter = 0;
+    for (auto [e, a, b] : reg.get<numbered<3>, numbered<140>>()) {
+        counter++;
+    }
+    ASSERT_EQ(counter, 1);
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<numbered<149>>(other)).value,
+              298u);
+}
+
+TEST(registry, column_lookup) {
+    registry reg;
+    entity_t low = reg.create();
+    entity_t high = reg.create();
+    // ids of numbered<200> and up are higher than any of the previous test
+    reg.add<numbered<201>>(low, numbered<201>{1});
+    reg.add<int>(low, 2);
+    reg.add<numbered<200>>(high, numbered<200>{3});
+    reg.add<numbered<201>>(high, numbered<201>{4});
+
+    auto [a, i] = reg.get_entity_components<numbered<201>, int>(low);
+    ASSERT_EQ(a.value, 1u);
+    ASSERT_EQ(i, 2);
+    auto [b, c] = reg.get_entity_components<numbered<201>, numbered<200>>(high);
+    ASSERT_EQ(b.value, 4u);
+    ASSERT_EQ(c.value, 3u);
+
+    // below and above the highest id of the archetype
+    ASSERT_THROW(reg.get_entity_components<float>(low), std::out_of_range);
+    ASSERT_THROW(reg.get_entity_components<numbered<202>>(high),
+                 std::out_of_range);
+    ASSERT_THROW(reg.get_entity_components<int>(high), std::out_of_range);
+
+    // ids past _dense_column_limit are searched in the sorted component ids
+    [&]<size_t... Ns>(std::index_sequence<Ns...>) {
+        (type_id_generator::get<numbered<1000 + Ns>>(), ...);
+    }(std::make_index_sequence<_dense_column_limit>{});
+    ASSERT_GE(type_id_generator::get<numbered<1000 + _dense_column_limit - 1>>(),
+              _dense_column_limit);
+    entity_t wide = reg.create();
+    reg.add<int>(wide, 5);
+    reg.add<numbered<1000 + _dense_column_limit - 1>>(wide);
+    reg.add<numbered<1000>>(wide, numbered<1000>{6});
+    auto [w, x, y] = reg.get_entity_components<
+        int, numbered<1000>, numbered<1000 + _dense_column_limit - 1>>(wide);
+    ASSERT_EQ(w, 5);
+    ASSERT_EQ(x.value, 6u);
+    ASSERT_EQ(y.value, 1000u + _dense_column_limit - 1);
+    ASSERT_THROW(reg.get_entity_components<float>(wide), std::out_of_range);
+    ASSERT_THROW(reg.get_entity_components<numbered<1001>>(wide),
+                 std::out_of_range);
+}
+
+TEST(registry, archetype_removal) {
+    registry reg;
+    for (chunk_id_t chunk = 0; chunk < 100; chunk++) {
+        reg.create<int>(chunk, static_cast<int>(chunk));
+        if (chunk % 2) {
+            reg.create<int, char>(chunk, static_cast<int>(chunk), 'c');
+        }
+    }
+    for (chunk_id_t chunk = 0; chunk < 100; chunk += 3) {
+        reg.destroy_if([](entity_t e, int& i) { return true; }, chunk);
+    }
+    // swaps the last archetypes into the freed positions
+    reg.collect_empty_archetypes();
+
+    auto count = [&](chunk_id_t chunk) {
+        int counter = 0;
+        for (auto [e, i] : reg.get<int>(chunk)) {
+            EXPECT_EQ(i, static_cast<int>(chunk));
+            counter++;
+        }
+        return counter;
+    };
+    for (chunk_id_t chunk = 0; chunk < 100; chunk++) {
+        ASSERT_EQ(count(chunk), chunk % 3 == 0 ? 0 : chunk % 2 ? 2 : 1);
+    }
+
+    // archetypes created after reuse the freed ids
+    for (chunk_id_t chunk = 0; chunk < 100; chunk += 3) {
+        reg.create<int, float>(chunk, static_cast<int>(chunk), 1.f);
+    }
+    for (chunk_id_t chunk = 0; chunk < 100; chunk++) {
+        ASSERT_EQ(count(chunk), chunk % 3 == 0 ? 1 : chunk % 2 ? 2 : 1);
+        int counter = 0;
+        reg.for_each([&](entity_t e, int& i) { counter++; }, chunk);
+        ASSERT_EQ(counter, count(chunk));
+    }
+}
+
+TEST(registry, chunks) {
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        // small blocks so that merges relocate across block boundaries
+        registry reg({policy, 64});
+        auto in_five = reg.query<int>(5);
+        std::vector<entity_t> unloaded;
+        for (int i = 0; i < 20; i++) {
+            reg.create<int>(1, int{i});
+            reg.create<int, std::string>(1, int{i}, std::to_string(i));
+            unloaded.push_back(reg.create<int, std::string>(2, int{i}, "unloaded"));
+            reg.create<int, std::string>(3, 100 + i, std::to_string(100 + i));
+        }
+        // entities without components belong to their chunk as well
+        unloaded.push_back(reg.create(2));
+        entity_t bare = reg.create(1);
+        entity_t other = reg.create(4);
+
+        reg.unload_chunk(2);
+        for (entity_t entity : unloaded) {
+            ASSERT_FALSE(reg.valid(entity));
+        }
+        ASSERT_EQ(reg.get<int>(2).begin(), reg.get<int>(2).end());
+
+        reg.move_chunk(1, 5);
+        ASSERT_EQ(in_five.archetypes().size(), 2u);
+        ASSERT_EQ(reg.get<int>(1).begin(), reg.get<int>(1).end());
+        int counter = 0;
+        for (auto [e, i, s] : reg.get<int, std::string>(5)) {
+            ASSERT_EQ(s, std::to_string(i));
+            counter++;
+        }
+        ASSERT_EQ(counter, 20);
+        reg.add<double>(bare, 1.);
+        reg.add<double>(other, 2.);
+        counter = 0;
+        reg.for_each([&](entity_t e, double& d) {
+            ASSERT_EQ(e, bare);
+            counter++;
+        }, 5);
+        ASSERT_EQ(counter, 1);
+        reg.remove<double>(bare);
+
+        // moved entities keep growing in their new chunk
+        entity_t moved = std::get<0>(*reg.get<int, std::string>(5).begin());
+        reg.add<char>(moved, 'c');
+        counter = 0;
+        reg.for_each([&](entity_t e, char& c) { counter++; }, 5);
+        ASSERT_EQ(counter, 1);
+
+        ASSERT_THROW(reg.move_chunk(3, 5), std::runtime_error);
+        ASSERT_EQ(std::distance(reg.get<int>(3).begin(), reg.get<int>(3).end()),
+                  20);
+
+        reg.merge_chunks(3, 5);
+        counter = 0;
+        for (auto [e, i, s] : reg.get<int, std::string>(5)) {
+            ASSERT_EQ(s, std::to_string(i));
+            auto [value] = reg.get_entity_components<std::string>(e);
+            ASSERT_EQ(value, s);
+            counter++;
+        }
+        // 20 appended to the 19 left after add<char>, plus the moved one
+        ASSERT_EQ(counter, 40);
+        counter = 0;
+        in_five.for_each([&](entity_t e, int& i) { counter++; });
+        ASSERT_EQ(counter, 60);
+    }
+}
+
+struct label {
+    std::string text;
+};
+
+template <>
+struct ant::component_serializer<label> {
+    static void write(std::ostream& out, const label* labels, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            binary::write_string(out, labels[i].text);
+        }
+    }
+
+    static void read(std::istream& in, label* storage, size_t count) {
+        std::vector<label> labels(count);
+        for (auto& l : labels) {
+            l.text = binary::read_string(in);
+        }
+        std::uninitialized_move_n(labels.begin(), count, storage);
+    }
+};
+
+struct unserializable {
+    std::vector<int> values;
+};
+
+TEST(registry, snapshot) {
+    registry reg;
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.push_back(
+            reg.create<int, label>(i % 3, int{i}, label{std::to_string(i)}));
+        if (i % 2) {
+            reg.add<float>(entities.back(), i * .5f);
+        }
+    }
+    entity_t empty = reg.create(7);
+    reg.destroy(entities[10]);
+    reg.destroy(entities[20]);
+    std::stringstream stream;
+    reg.snapshot(stream);
+    const std::string bytes = stream.str();
+
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry restored({policy, 256});
+        restored.save<float, label, int>();
+        std::stringstream in(bytes);
+        restored.restore(in);
+
+        ASSERT_TRUE(restored.valid(empty));
+        ASSERT_FALSE(restored.valid(entities[10]));
+        for (int i = 0; i < 100; i++) {
+            if (i == 10 || i == 20) {
+                continue;
+            }
+            auto [value, l] = restored.get_entity_components<int, label>(
+                entities[i]);
+            ASSERT_EQ(value, i);
+            ASSERT_EQ(l.text, std::to_string(i));
+        }
+        int counter = 0;
+        restored.for_each(
+            [&](entity_t e, float& f, int& i) {
+                ASSERT_EQ(f, i * .5f);
+                counter++;
+            },
+            1);
+        ASSERT_EQ(counter, 17);
+
+        // the free list is restored too, recycling the same records
+        entity_t recycled = restored.create();
+        ASSERT_EQ(get_entity_index(recycled), get_entity_index(entities[20]));
+        ASSERT_NE(recycled, entities[20]);
+    }
+
+    registry truncated;
+    truncated.save<int, label, float>();
+    entity_t previous = truncated.create<int>(0, 1);
+    std::stringstream in(bytes.substr(0, bytes.size() / 2));
+    ASSERT_THROW(truncated.restore(in), std::runtime_error);
+    ASSERT_FALSE(truncated.valid(previous));
+
+    registry unregistered;
+    unregistered.save<int>();
+    entity_t kept = unregistered.create<int>(0, 2);
+    std::stringstream again(bytes);
+    ASSERT_THROW(unregistered.restore(again), std::runtime_error);
+    ASSERT_EQ(std::get<0>(unregistered.get_entity_components<int>(kept)), 2);
+
+    reg.create<unserializable>(0, unserializable{});
+    std::stringstream out;
+    ASSERT_THROW(reg.snapshot(out), std::runtime_error);
+}
+
+TEST(registry, mapped_snapshot) {
+    const std::string path
+        = (std::filesystem::temp_directory_path() / "antity_mapped_snapshot")
+              .string();
+    registry reg;
+    reg.save<int, float, label>();
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 1000; i++) {
+        entities.push_back(reg.create<int, float>(0, int{i}, i * .5f));
+    }
+    reg.create<int>(1, 7);
+    reg.destroy(entities[3]);
+    reg.snapshot_mapped(path);
+
+    auto read_file = [&] {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    };
+    const std::string bytes = read_file();
+
+    registry restored;
+    restored.save<int, float>();
+    // replaced by the snapshot content
+    restored.create<int, float>(0, -1, 0.f);
+    restored.restore_mapped(path);
+    ASSERT_FALSE(restored.valid(entities[3]));
+    int counter = 0;
+    restored.for_each([&](entity_t e, int& i, float& f) {
+        ASSERT_EQ(f, i * .5f);
+        counter++;
+    }, 0);
+    ASSERT_EQ(counter, 999);
+    ASSERT_EQ(std::get<0>(restored.get_entity_components<int>(entities[0])), 0);
+
+    // writes go to private copies of the pages, growing copies the columns
+    restored.for_each([](entity_t e, int& i, float& f) { i = -i; }, 0);
+    restored.destroy(entities[0]);
+    for (int i = 0; i < 1000; i++) {
+        restored.create<int, float>(0, int{i}, 0.f);
+    }
+    ASSERT_EQ(std::get<0>(restored.get_entity_components<int>(entities[999])), -999);
+    ASSERT_EQ(std::get<0>(restored.get_entity_components<float>(entities[999])), 499.5f);
+    ASSERT_EQ(read_file(), bytes);
+
+    // the file is also a regular source of restore_mapped after the registry
+    // that mapped it is restored again
+    restored.restore_mapped(path);
+    ASSERT_EQ(std::get<0>(restored.get_entity_components<int>(entities[999])), 999);
+
+    registry chunked({storage_policy::chunked, 256});
+    chunked.save<int, float>();
+    ASSERT_THROW(chunked.restore_mapped(path), std::logic_error);
+
+    registry unregistered;
+    unregistered.save<int>();
+    ASSERT_THROW(unregistered.restore_mapped(path), std::runtime_error);
+
+    // stream snapshots and mapped ones aren't interchangeable
+    std::stringstream stream(bytes);
+    ASSERT_THROW(restored.restore(stream), std::runtime_error);
+
+    reg.create<label>(0, label{"text"});
+    ASSERT_THROW(reg.snapshot_mapped(path), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST(registry, delta_snapshot) {
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry reg({policy, 256});
+        reg.save<int, float, label>();
+        std::vector<entity_t> entities;
+        for (int i = 0; i < 200; i++) {
+            entities.push_back(reg.create<int, float>(0, int{i}, i * .5f));
+        }
+        for (int i = 0; i < 20; i++) {
+            entities.push_back(reg.create<int, label>(
+                1, int{i}, label{std::to_string(i)}));
+        }
+        std::stringstream base;
+        reg.snapshot(base);
+        uint64_t epoch = reg.checkpoint();
+
+        registry replica({policy, 256});
+        replica.save<int, float, label>();
+        replica.restore(base);
+
+        auto sync = [&] {
+            std::stringstream delta;
+            reg.snapshot_delta(delta, epoch);
+            epoch = reg.checkpoint();
+            replica.apply_delta(delta);
+            for (entity_t entity : entities) {
+                EXPECT_EQ(replica.valid(entity), reg.valid(entity));
+            }
+            int counter = 0;
+            reg.for_each(
+                [&](entity_t e, const int& i, const float& f) {
+                    auto [ri, rf]
+                        = replica.get_entity_components<int, float>(e);
+                    EXPECT_EQ(ri, i);
+                    EXPECT_EQ(rf, f);
+                    counter++;
+                },
+                0);
+            replica.for_each(
+                [&](entity_t e, const int&, const float&) { counter--; }, 0);
+            EXPECT_EQ(counter, 0);
+            reg.for_each(
+                [&](entity_t e, const label& l) {
+                    auto [rl] = replica.get_entity_components<label>(e);
+                    EXPECT_EQ(rl.text, l.text);
+                    counter++;
+                },
+                1);
+            replica.for_each([&](entity_t e, const label&) { counter--; }, 1);
+            EXPECT_EQ(counter, 0);
+            return delta.str().size();
+        };
+
+        // structural changes
+        reg.destroy(entities[5]);
+        entities.push_back(reg.create<int, float>(0, 1000, 1.f));
+        reg.remove<float>(entities[7]);
+        reg.add<label>(entities[8], label{"added"});
+        sync();
+
+        // values only, the unchanged archetypes and columns are left out
+        reg.for_each([](entity_t e, const int& i, float& f) { f += i; }, 0);
+        const size_t values = sync();
+        ASSERT_LT(values, base.str().size() / 2);
+
+        std::get<0>(reg.get_entity_components<float>(entities[150])) = -1.f;
+        const size_t single = sync();
+        ASSERT_LE(single, values);
+        if (policy == storage_policy::chunked) {
+            ASSERT_LT(single, values);
+        }
+
+        // nothing changed
+        ASSERT_LE(sync(), single);
+
+        // emptied archetypes and recycled entities
+        for (int i = 200; i < 220; i++) {
+            reg.destroy(entities[i]);
+        }
+        entities.push_back(reg.create<int>(1, 1));
+        sync();
+
+        std::stringstream wrong(base.str());
+        ASSERT_THROW(replica.apply_delta(wrong), std::runtime_error);
+    }
+}
+
+TEST(registry, change_filters) {
+    struct dead {
+        bool value;
+    };
+    // 32 rows of int and float per block
+    registry reg({storage_policy::chunked, 256});
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 320; i++) {
+        entities.push_back(reg.create<int, float>(0, int{i}, 0.f));
+    }
+    auto count = [&](const auto&... filters) {
+        int counter = 0;
+        reg.for_each([&](entity_t e, const int& i) { counter++; }, 0,
+                     filters...);
+        return counter;
+    };
+
+    uint64_t since = reg.checkpoint();
+    ASSERT_EQ(count(changed<int>{since}), 0);
+    ASSERT_EQ(count(added<int>{since - 1}), 320);
+
+    // read only accesses don't count
+    reg.for_each([](entity_t e, const int& i, const float& f) {}, 0);
+    std::get<0>(reg.get_entity_components<const float>(entities[40]));
+    ASSERT_EQ(count(changed<float>{since}), 0);
+
+    std::get<0>(reg.get_entity_components<float>(entities[40])) = 1.f;
+    ASSERT_EQ(count(changed<float>{since}), 32);
+    ASSERT_EQ(count(changed<int>{since}), 0);
+    ASSERT_EQ(count(changed<float>{since}, added<float>{since}), 0);
+
+    // the mark follows the entity when it moves to another archetype
+    since = reg.checkpoint();
+    std::get<0>(reg.get_entity_components<float>(entities[300])) = 2.f;
+    reg.add<dead>(entities[300], dead{true});
+    int counter = 0;
+    reg.for_each([&](entity_t e, float& f) { counter++; }, 0,
+                 changed<float>{since}, added<dead>{since});
+    ASSERT_EQ(counter, 1);
+    // the last entity filled its row in the same block
+    ASSERT_EQ(count(changed<float>{since}), 1 + 31);
+
+    // filtered writes only mark the visited blocks
+    since = reg.checkpoint();
+    const uint64_t before = reg.checkpoint();
+    reg.for_each([](entity_t e, float& f) { f += 1.f; }, 0,
+                 changed<float>{since - 1});
+    ASSERT_EQ(count(changed<float>{before}), 1 + 31);
+
+    auto q = reg.query<int, float>(0);
+    counter = 0;
+    q.for_each([&](entity_t e, int& i, float& f) { counter++; },
+               added<dead>{0});
+    ASSERT_EQ(counter, 1);
+}
+
+TEST(registry, query_filters) {
+    struct frozen {};
+    struct hidden {
+        bool value;
+    };
+    registry reg;
+    for (int i = 0; i < 10; i++) {
+        reg.create<int>(_null_chunk, int{i});
+        reg.create<int, float>(_null_chunk, int{i}, float(i));
+        reg.create<int, hidden>(_null_chunk, int{i}, hidden{true});
+        reg.create<int, float, hidden>(_null_chunk, int{i}, float(i),
+                                      hidden{false});
+    }
+    auto count = [&](const auto&... filters) {
+        int counter = 0;
+        reg.for_each([&](entity_t e, const int& i) { counter++; },
+                     filters...);
+        return counter;
+    };
+
+    ASSERT_EQ(count(exclude<hidden>), 20);
+    ASSERT_EQ(count(exclude<hidden, float>), 10);
+    ASSERT_EQ(count(any_of<float, hidden>), 30);
+    ASSERT_EQ(count(any_of<float>, exclude<hidden>), 10);
+    ASSERT_EQ(count(optional<float>), 40);
+    // unknown components
+    ASSERT_EQ(count(exclude<frozen>), 40);
+    ASSERT_EQ(count(any_of<frozen>), 0);
+
+    // optional components are pointer parameters, null when missing
+    int with = 0, without = 0;
+    reg.for_each(
+        [&](entity_t e, int& i, float* f) {
+            if (f) {
+                ASSERT_EQ(*f, float(i));
+                *f += 1.f;
+                with++;
+            } else {
+                without++;
+            }
+        },
+        exclude<hidden>);
+    ASSERT_EQ(with, 10);
+    ASSERT_EQ(without, 10);
+
+    const uint64_t since = reg.checkpoint();
+    with = without = 0;
+    for (auto [e, i, h, f] :
+         reg.get<int>(exclude<frozen>, optional<hidden>, optional<float>)) {
+        if (f) {
+            with++;
+            *f = 0.f;
+        } else {
+            without++;
+        }
+        if (h) {
+            ASSERT_EQ(h->value, !f);
+        }
+    }
+    ASSERT_EQ(with, 20);
+    ASSERT_EQ(without, 20);
+    ASSERT_EQ(count(changed<float>{since}), 20);
+    ASSERT_EQ(count(changed<hidden>{since}), 20);
+
+    int visited = 0;
+    for (auto [e, i] : reg.get<int>(_null_chunk, any_of<hidden>,
+                                          exclude<float>)) {
+        visited++;
+    }
+    ASSERT_EQ(visited, 10);
+}
+
+TEST(registry, tag_components) {
+    struct player {};
+    struct dead {};
+    static_assert(is_tag_v<dead> && !is_tag_v<int>);
+
+    registry reg;
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.push_back(i % 2 ? reg.create<int, player>(0, int{i}, {})
+                                 : reg.create<int>(0, int{i}));
+    }
+    auto created = reg.create_n<int, dead>(10, 0, int{-1}, dead{});
+    for (int i = 0; i < 100; i += 4) {
+        reg.add<dead>(entities[i]);
+    }
+    reg.remove<player>(entities[1]);
+
+    // tags move along without touching the other components
+    auto [value] = reg.get_entity_components<int>(entities[1]);
+    ASSERT_EQ(value, 1);
+    auto [tag] = reg.get_entity_components<player>(entities[3]);
+    (void)tag;
+    ASSERT_THROW(reg.get_entity_components<player>(entities[1]),
+                 std::out_of_range);
+
+    auto count = [&](const auto&... filters) {
+        int counter = 0;
+        reg.for_each([&](entity_t e, const int& i) { counter++; }, 0,
+                     filters...);
+        return counter;
+    };
+    ASSERT_EQ(count(), 110);
+    ASSERT_EQ(count(exclude<dead>), 75);
+    ASSERT_EQ(count(any_of<player, dead>), 49 + 25 + 10);
+
+    int players = 0;
+    reg.for_each(
+        [&](entity_t e, int& i, const player&, dead* d) {
+            ASSERT_EQ(i % 2, 1);
+            ASSERT_EQ(d, nullptr);
+            players++;
+        },
+        0);
+    ASSERT_EQ(players, 49);
+
+    int dead_count = 0;
+    for (auto [e, i, d] : reg.get<int>(0, optional<dead>)) {
+        if (d) {
+            ASSERT_TRUE(i % 4 == 0 || i == -1);
+            dead_count++;
+        }
+    }
+    ASSERT_EQ(dead_count, 35);
+    int visited = 0;
+    for (auto [e, i, d] : reg.get<int, dead>(0)) {
+        visited++;
+    }
+    ASSERT_EQ(visited, 35);
+
+    command_buffer buffer;
+    buffer.add<player>(entities[0]);
+    buffer.add<dead>(entities[3]);
+    buffer.add<dead>(entities[4]);
+    reg.apply(buffer);
+    ASSERT_EQ(count(any_of<player>), 50);
+    ASSERT_EQ(count(any_of<dead>), 36);
+
+    std::stringstream stream;
+    reg.snapshot(stream);
+    registry restored;
+    restored.save<int, dead, player>();
+    restored.restore(stream);
+    int restored_count = 0;
+    restored.for_each(
+        [&](entity_t e, const int& i, const dead&) { restored_count++; }, 0,
+        any_of<player>);
+    // entities 0 and 3
+    ASSERT_EQ(restored_count, 2);
+}
+
+TEST(registry, for_each_span) {
+    struct position {
+        float x, y;
+    };
+    struct frozen {};
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry reg({policy, 1024});
+        for (int i = 0; i < 1000; i++) {
+            if (i % 5) {
+                reg.create<position, float>(0, {float(i), 0.f}, 2.f);
+            } else {
+                reg.create<position, float, frozen>(0, {float(i), 0.f}, 2.f,
+                                                    {});
+            }
+        }
+
+        const uint64_t since = reg.checkpoint();
+        size_t rows = 0, calls = 0;
+        reg.for_each_span(
+            [&](std::span<const entity_t> entities,
+                std::span<position> positions, std::span<const float> speeds) {
+                ASSERT_EQ(entities.size(), positions.size());
+                ASSERT_EQ(entities.size(), speeds.size());
+                position* p = aligned_data(positions);
+                const float* s = aligned_data(speeds);
+                ASSERT_EQ(reinterpret_cast<uintptr_t>(p) % _column_alignment,
+                          0);
+                for (size_t i = 0; i < positions.size(); i++) {
+                    p[i].y += s[i];
+                }
+                rows += entities.size();
+                calls++;
+            },
+            0, exclude<frozen>);
+        ASSERT_EQ(rows, 800);
+        if (policy == storage_policy::contiguous) {
+            ASSERT_EQ(calls, 1);
+        } else {
+            ASSERT_GT(calls, 1);
+        }
+
+        int moved = 0;
+        reg.for_each(
+            [&](entity_t e, const position& p) { moved += p.y == 2.f; }, 0);
+        ASSERT_EQ(moved, 800);
+
+        // writes are tracked per span, read only spans aren't
+        rows = 0;
+        reg.for_each_span(
+            [&](std::span<const entity_t> entities,
+                std::span<const position>) { rows += entities.size(); },
+            0, changed<position>{since});
+        ASSERT_EQ(rows, 800);
+        rows = 0;
+        reg.for_each_span([&](std::span<const entity_t> entities,
+                              std::span<float>) { rows += entities.size(); },
+                          0, changed<float>{since});
+        ASSERT_EQ(rows, 0);
+    }
+}
+
+struct soa_position {
+    float x, y;
+};
+
+template <>
+struct ant::soa_layout<soa_position> {
+    static constexpr auto fields
+        = std::make_tuple(&soa_position::x, &soa_position::y);
+};
+
+TEST(registry, soa_layout) {
+    static_assert(soa_component<soa_position>);
+    static_assert(soa_index<soa_position, &soa_position::y> == 1);
+    for (auto policy : {storage_policy::contiguous, storage_policy::chunked}) {
+        registry reg({policy, 512});
+        std::vector<entity_t> entities;
+        for (int i = 0; i < 100; i++) {
+            entities.push_back(reg.create<soa_position, float>(
+                0, soa_position{float(i), float(-i)}, 1.f));
+        }
+        reg.create_n<soa_position>(10, 0, soa_position{-1.f, 1.f});
+        auto more = reg.create_n<soa_position, int>(10, 0, [](size_t i) {
+            return std::tuple{soa_position{float(i), 0.f}, int(i)};
+        });
+        reg.add<soa_position>(reg.create(0), 5.f, 6.f);
+
+        int visited = 0;
+        reg.for_each(
+            [&](entity_t e, soa_ref<soa_position> p, const float& speed) {
+                ASSERT_EQ(p.get<&soa_position::x>(), -p.field<1>());
+                p.field<1>() += speed;
+                visited++;
+            },
+            0);
+        ASSERT_EQ(visited, 100);
+
+        const uint64_t since = reg.checkpoint();
+        size_t rows = 0;
+        reg.for_each_span(
+            [&](std::span<const entity_t> e, soa_span<soa_position> p,
+                std::span<const float> speed) {
+                auto x = p.get<&soa_position::x>();
+                auto y = p.field<1>();
+                ASSERT_EQ(x.size(), e.size());
+                for (size_t i = 0; i < x.size(); i++) {
+                    x[i] += speed[i] * 2.f;
+                }
+                ASSERT_EQ(soa_position(p[0]).y, y[0]);
+                rows += e.size();
+            },
+            0);
+        ASSERT_EQ(rows, 100);
+
+        int changed_rows = 0;
+        reg.for_each(
+            [&](entity_t e, soa_ref<const soa_position> p) {
+                const soa_position value = p;
+                ASSERT_EQ(value.x, 2.f - value.y + 1.f);
+                changed_rows++;
+            },
+            0, changed<soa_position>{since}, exclude<int>);
+        ASSERT_EQ(changed_rows, 100);
+
+        // the fields move with the entity
+        reg.remove<float>(entities[3]);
+        reg.add<double>(entities[4], 1.0);
+        command_buffer buffer;
+        buffer.add<soa_position>(entities[5], soa_position{7.f, 8.f});
+        buffer.remove<soa_position>(entities[6]);
+        reg.apply(buffer);
+        std::map<entity_t, soa_position> values;
+        reg.for_each(
+            [&](entity_t e, soa_ref<soa_position> p) { values[e] = p; }, 0);
+        ASSERT_EQ(values.size(), 100 + 10 + 10 + 1 - 1);
+        ASSERT_EQ(values[entities[3]].x, 5.f);
+        ASSERT_EQ(values[entities[4]].y, -3.f);
+        ASSERT_EQ(values[entities[5]].x, 7.f);
+        ASSERT_FALSE(values.contains(entities[6]));
+        ASSERT_EQ(values[more[9]].x, 9.f);
+
+        reg.remove<soa_position>(entities[7]);
+        ASSERT_EQ(count_if(values.begin(), values.end(),
+                           [](auto& v) { return v.second.x == -1.f; }),
+                  10);
+
+        std::stringstream stream;
+        reg.snapshot(stream);
+        registry restored({policy, 512});
+        restored.save<soa_position, float, int, double>();
+        restored.restore(stream);
+        int restored_rows = 0;
+        restored.for_each(
+            [&](entity_t e, soa_ref<const soa_position> p) {
+                ASSERT_EQ(soa_position(p).x, values[e].x);
+                restored_rows++;
+            },
+            0);
+        ASSERT_EQ(restored_rows, 100 + 10 + 10 + 1 - 2);
+    }
+}
+
+TEST(registry, scheduler) {
+    registry reg;
+    reg.set_worker_count(4);
+    for (int i = 0; i < 1000; i++) {
+        reg.create<int, float, double, char>(_null_chunk, 0, 1.f, 0., 'a');
+    }
+    reg.create<int>(1, 0);
+
+    std::atomic<int> sum = 0;
+    std::atomic<int> chars = 0;
+    scheduler systems(reg);
+    systems
+        .add([](entity_t, int& i, const float& f) {
+            i += static_cast<int>(f);
+        })
+        .add([](entity_t, const int& i, double& d) { d = i; })
+        .add([](entity_t, float& f) { f += 1.f; })
+        .add([](entity_t, char& c) { c++; })
+        .add([&](std::span<const entity_t>, std::span<const double> d) {
+            for (double value : d) {
+                sum += static_cast<int>(value);
+            }
+        })
+        .add([&](entity_t, const char&) { chars++; }, changed<float>{0})
+        .add([](entity_t, int& i) { i--; }, 1);
+
+    ASSERT_EQ(systems.size(), 7);
+    ASSERT_EQ(systems.dependencies(0), std::vector<size_t>{});
+    ASSERT_EQ(systems.dependencies(1), std::vector<size_t>{0});
+    ASSERT_EQ(systems.dependencies(2), std::vector<size_t>{0});
+    ASSERT_EQ(systems.dependencies(3), std::vector<size_t>{});
+    ASSERT_EQ(systems.dependencies(4), std::vector<size_t>{1});
+    ASSERT_EQ(systems.dependencies(5), (std::vector<size_t>{2, 3}));
+    ASSERT_EQ(systems.dependencies(6), std::vector<size_t>{});
+
+    // each frame reads what the conflicting systems before it wrote
+    for (int frame = 1; frame <= 10; frame++) {
+        sum = 0;
+        systems.run();
+        ASSERT_EQ(sum, 1000 * frame * (frame + 1) / 2);
+    }
+    ASSERT_EQ(chars, 10 * 1000);
+    reg.for_each([](entity_t, int& i, float& f, double& d, char& c) {
+        ASSERT_EQ(i, 55);
+        ASSERT_EQ(f, 11.f);
+        ASSERT_EQ(d, 55.);
+        ASSERT_EQ(c, 'a' + 10);
+    });
+    reg.for_each([](entity_t, int& i) { ASSERT_EQ(i, -10); }, 1);
+
+    // par_for_each runs inline within a system
+    std::atomic<int> visited = 0;
+    scheduler nested(reg);
+    nested.add([&](entity_t, const char&) {
+        reg.par_for_each([&](entity_t, const int&) { visited++; }, 1);
+    });
+    nested.run();
+    ASSERT_EQ(visited, 1000);
+
+    scheduler failing(reg);
+    failing.add([&](entity_t, int&) { reg.create(); });
+    ASSERT_THROW(failing.run(), std::logic_error);
+    ASSERT_TRUE(reg.valid(reg.create<int>(_null_chunk, 0)));
+}
+
+TEST(registry, observers) {
+    registry reg;
+    std::vector<entity_t> int_added;
+    std::vector<int> int_removed;
+    std::vector<std::vector<entity_t>> float_batches;
+    std::vector<entity_t> destroyed;
+    int soa_added = 0;
+    int soa_removed = 0;
+
+    reg.on_add<int>([&](entity_t e) {
+        int_added.push_back(e);
+        ASSERT_THROW(reg.create(), std::logic_error);
+        ASSERT_THROW(reg.flush_observers(), std::logic_error);
+    });
+    // immediate remove observers still see the component
+    reg.on_remove<int>([&](entity_t e) {
+        int_removed.push_back(std::get<0>(reg.get_entity_components<int>(e)));
+    });
+    reg.on_add<float>([&](std::span<const entity_t> entities) {
+        float_batches.emplace_back(entities.begin(), entities.end());
+    });
+    const observer_id destroy_observer
+        = reg.on_destroy([&](std::span<const entity_t> entities) {
+              destroyed.insert(destroyed.end(), entities.begin(),
+                               entities.end());
+          });
+    reg.on_add<soa_position>([&](entity_t) { soa_added++; });
+    reg.on_remove<soa_position>([&](entity_t) { soa_removed++; });
+
+    entity_t a = reg.create<int, float>(_null_chunk, 1, 1.f);
+    ASSERT_EQ(int_added, std::vector<entity_t>{a});
+    std::vector<entity_t> many = reg.create_n<int>(10, _null_chunk, 2);
+    ASSERT_EQ(int_added.size(), 11);
+    for (size_t i = 0; i < 4; i++) {
+        reg.add<float>(many[i], 2.f);
+    }
+    reg.add<double>(many[0], 0.);
+    reg.add<float>(reg.create(), 3.f);
+    ASSERT_TRUE(float_batches.empty());
+
+    reg.flush_observers();
+    // grouped by the archetype entered
+    ASSERT_EQ(float_batches.size(), 2);
+    ASSERT_EQ(float_batches[0], (std::vector<entity_t>{a, many[0], many[1],
+                                                       many[2], many[3]}));
+    ASSERT_EQ(float_batches[1].size(), 1);
+    reg.flush_observers();
+    ASSERT_EQ(float_batches.size(), 2);
+
+    reg.remove<int>(many[5]);
+    ASSERT_EQ(int_removed, std::vector<int>{2});
+    // removing a missing component and replacing a held one notify nothing
+    reg.remove<int>(many[5]);
+    reg.remove<char>(many[6]);
+    ASSERT_EQ(int_removed, std::vector<int>{2});
+    reg.add<int>(many[6], 3);
+    ASSERT_EQ(int_added.size(), 11);
+    reg.destroy(many[6]);
+    reg.destroy(std::vector<entity_t>{many[7], many[8], many[5]});
+    reg.destroy_if([](entity_t, double&) { return true; });
+    ASSERT_EQ(int_removed.size(), 5);
+    ASSERT_TRUE(destroyed.empty());
+    reg.flush_observers();
+    ASSERT_EQ(destroyed.size(), 5);
+    ASSERT_EQ(std::set<entity_t>(destroyed.begin(), destroyed.end()),
+              (std::set<entity_t>{many[0], many[5], many[6], many[7],
+                                  many[8]}));
+
+    command_buffer buffer;
+    buffer.add<float>(many[9], 4.f);
+    buffer.remove<int>(many[4]);
+    buffer.destroy(many[3]);
+    entity_t created = buffer.create();
+    buffer.add<int>(created, 5);
+    reg.apply(buffer);
+    ASSERT_EQ(int_removed.size(), 7);
+    ASSERT_EQ(int_added.size(), 12);
+    reg.flush_observers();
+    ASSERT_EQ(float_batches.back(), std::vector<entity_t>{many[9]});
+    ASSERT_EQ(destroyed.back(), many[3]);
+
+    entity_t soa = reg.create();
+    reg.add<soa_position>(soa, soa_position{1.f, 2.f});
+    reg.create<soa_position>(_null_chunk, soa_position{});
+    ASSERT_EQ(soa_added, 2);
+    reg.remove<soa_position>(soa);
+    reg.unload_chunk(_null_chunk);
+    ASSERT_EQ(soa_removed, 2);
+
+    reg.disconnect(destroy_observer);
+    destroyed.clear();
+    reg.destroy(reg.create<int>(_null_chunk, 0));
+    reg.flush_observers();
+    ASSERT_TRUE(destroyed.empty());
+}
+
+struct burning {
+    int damage;
+};
+
+template <>
+struct ant::sparse_storage<burning> : std::true_type {};
+
+TEST(registry, sparse_storage) {
+    registry reg;
+    std::vector<entity_t> entities;
+    for (int i = 0; i < 100; i++) {
+        entities.push_back(
+            reg.create<int, float>(_null_chunk, int{i}, static_cast<float>(i)));
+    }
+    entity_t bare = reg.create();
+    int* first_int = &std::get<0>(reg.get_entity_components<int>(entities[0]));
+
+    int burnt = 0;
+    reg.on_remove<burning>([&](entity_t) { burnt++; });
+    for (int i = 0; i < 100; i += 10) {
+        reg.add<burning>(entities[i], i);
+    }
+    reg.add<burning>(bare, 1000);
+    // toggling never moves the entity
+    ASSERT_EQ(first_int,
+              &std::get<0>(reg.get_entity_components<int>(entities[0])));
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<burning>(entities[20]))
+                  .damage,
+              20);
+    ASSERT_THROW(reg.get_entity_components<burning>(entities[1]),
+                 std::out_of_range);
+
+    // driven by the set, joined with the archetype components
+    int visited = 0;
+    reg.for_each([&](entity_t e, int& i, const burning& b) {
+        ASSERT_EQ(i, b.damage);
+        i += 1000;
+        visited++;
+    });
+    ASSERT_EQ(visited, 10);
+    visited = 0;
+    reg.for_each([&](entity_t e, burning& b) { visited++; });
+    ASSERT_EQ(visited, 11);
+    // optional sparse components, the archetypes drive
+    int with = 0;
+    int without = 0;
+    reg.for_each([&](entity_t e, const float& f, burning* b) {
+        (b ? with : without)++;
+    });
+    ASSERT_EQ(with, 10);
+    ASSERT_EQ(without, 90);
+    visited = 0;
+    reg.for_each([&](entity_t e, int& i, burning& b) { visited++; },
+                 exclude<float>);
+    ASSERT_EQ(visited, 0);
+
+    reg.remove<burning>(entities[10]);
+    reg.remove<burning>(entities[11]);
+    ASSERT_EQ(burnt, 1);
+    reg.destroy(entities[20]);
+    reg.destroy(bare);
+    ASSERT_EQ(burnt, 3);
+
+    command_buffer buffer;
+    reg.for_each([&](entity_t e, int& i, const burning&) {
+        buffer.remove<burning>(e);
+        buffer.add<burning>(entities[i - 1000 + 1], 7);
+    });
+    reg.apply(buffer);
+    visited = 0;
+    reg.for_each([&](entity_t e, burning& b) {
+        ASSERT_EQ(b.damage, 7);
+        visited++;
+    });
+    ASSERT_EQ(visited, 8);
+
+    // sparse components aren't serialized
+    std::stringstream stream;
+    ASSERT_THROW(reg.snapshot(stream), std::runtime_error);
+    ASSERT_TRUE(stream.str().empty());
+    for (int i = 1; i < 100; i += 10) {
+        reg.remove<burning>(entities[i]);
+    }
+    reg.snapshot(stream);
+    reg.restore(stream);
+    ASSERT_EQ(std::get<0>(reg.get_entity_components<int>(entities[1])), 1);
+}
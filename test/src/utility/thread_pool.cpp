@@ -0,0 +1,27 @@
+#include <gtest/gtest.h>
+
+#include <antity/utility/thread_pool.hpp>
+#include <atomic>
+
+using namespace ant;
+
+TEST(thread_pool, run_and_wait) {
+    thread_pool pool(3);
+    ASSERT_EQ(pool.size(), 3u);
+
+    std::atomic<int> counter = 0;
+    for (int i = 0; i < 1000; i++) {
+        pool.submit([&] {
+            counter++;
+            if (counter % 10 == 0) {
+                pool.submit([&] { counter++; });
+            }
+        });
+    }
+    pool.wait();
+    ASSERT_GE(counter, 1000);
+
+    pool.submit([] { throw std::runtime_error("task"); });
+    ASSERT_THROW(pool.wait(), std::runtime_error);
+    pool.wait();
+}
@@ -14,10 +14,42 @@ TEST(TypeIDGen, genID) {
 
     ASSERT_EQ(get_type_signature<int>(), get_type_signature<int>());
     ASSERT_EQ(get_type_signature<float>(), get_type_signature<float>());
-    ASSERT_EQ(get_type_signature<int>(), std::bitset<_max_components>(1ULL));
-    ASSERT_EQ(
-        get_type_signature<float>(),
-        std::bitset<_max_components>(1ULL << type_id_generator::get<float>()));
+    ASSERT_TRUE(get_type_signature<int>().test(type_id_generator::get<int>()));
+    ASSERT_EQ(get_type_signature<float>().count(), 1u);
+    ASSERT_NE(get_type_signature<int>(), get_type_signature<float>());
+}
+
+TEST(signature, large_ids) {
+    signature_t small;
+    small.set(3);
+    signature_t large;
+    large.set(3).set(130).set(1000);
+    ASSERT_EQ(large.count(), 3u);
+    ASSERT_TRUE(large.contains(small));
+    ASSERT_FALSE(small.contains(large));
+    ASSERT_TRUE(large.intersects(small));
+
+    std::vector<size_t> bits;
+    large.for_each([&](size_t bit) { bits.push_back(bit); });
+    ASSERT_EQ(bits, (std::vector<size_t>{3, 130, 1000}));
+
+    signature_t copy = large;
+    ASSERT_EQ(copy, large);
+    ASSERT_EQ(std::hash<signature_t>{}(copy), std::hash<signature_t>{}(large));
+    copy.reset(1000).reset(130);
+    ASSERT_EQ(copy, small);
+    ASSERT_EQ(std::hash<signature_t>{}(copy), std::hash<signature_t>{}(small));
+    copy.reset(3);
+    ASSERT_TRUE(copy.none());
+
+    signature_t moved = std::move(large);
+    ASSERT_TRUE(moved.test(1000));
+    ASSERT_TRUE(large.none());
+    large = moved & small;
+    ASSERT_EQ(large, small);
+    moved.subtract(small);
+    ASSERT_FALSE(moved.test(3));
+    ASSERT_EQ(moved.count(), 2u);
 }
 
 TEST(function_traits, all) {